@@ -35,7 +35,7 @@ unix {
     target.path = $${DESTDIR}$${bindir}
 }
 
-QT += core dbus
+QT += core dbus network
 QT -= gui
 
 TARGET = dbus-redflow
@@ -66,6 +66,12 @@ SOURCES += \
     src/main.cpp \
     src/dbus_bridge.cpp \
     src/modbus_rtu.cpp \
+    src/modbus_counters.cpp \
+    src/modbus_transport.cpp \
+    src/serial_transport.cpp \
+    src/tcp_transport.cpp \
+    src/recording_transport.cpp \
+    src/replay_transport.cpp \
     src/v_bus_node.cpp \
     src/crc16.cpp \
     src/settings.cpp \
@@ -74,6 +80,11 @@ SOURCES += \
     src/battery_controller_settings.cpp \
     src/battery_controller_settings_bridge.cpp \
     src/battery_controller_updater.cpp \
+    src/battery_controller_scanner.cpp \
+    src/bus_worker.cpp \
+    src/statistics.cpp \
+    src/debug_bridge.cpp \
+    src/sample_trace.cpp \
     src/battery_controller_bridge.cpp \
     src/batteryController.cpp \
     src/dbus_redflow.cpp
@@ -91,6 +102,12 @@ HEADERS += \
     src/defines.h \
     src/settings.h \
     src/modbus_rtu.h \
+    src/modbus_counters.h \
+    src/modbus_transport.h \
+    src/serial_transport.h \
+    src/tcp_transport.h \
+    src/recording_transport.h \
+    src/replay_transport.h \
     src/v_bus_node.h \
     src/crc16.h \
     src/settings_bridge.h \
@@ -101,7 +118,12 @@ HEADERS += \
     src/battery_controller_settings_bridge.h \
     src/battery_controller_bridge.h \
     src/batteryController.h \
-    src/battery_controller_updater.h
+    src/battery_controller_updater.h \
+    src/battery_controller_scanner.h \
+    src/bus_worker.h \
+    src/statistics.h \
+    src/debug_bridge.h \
+    src/sample_trace.h
 
 DISTFILES += \
     src/service/run \
@@ -9,6 +9,7 @@ BatteryController::BatteryController(const QString &portName, int deviceAddress,
 	mErrorCode(0),
 	mFirmwareVersion(0),
 	mPortName(portName),
+	mSlaveAddress(deviceAddress),
 	mBattVolts(0),
 	mBussVolts(0),
 	mBattAmps(0),
@@ -29,7 +30,10 @@ BatteryController::BatteryController(const QString &portName, int deviceAddress,
 	mClearStatusRegisterFlags(0),
 	mRequestDelayedSelfMaintenance(0),
 	mSetOperationalMode(0),
-	mRequestImmediateSelfMaintenance(0)
+	mRequestImmediateSelfMaintenance(0),
+	mEnableSelfMaintenanceAtTheEndOfDischarge(0),
+	mEnterRunCommand(0),
+	mSelfDischargeAndMaintenanceCycle(0)
 {
 	
 }
@@ -73,6 +77,55 @@ void BatteryController::setDeviceSubType(int t)
 	emit deviceSubTypeChanged();
 }
 
+void BatteryController::setParameters(const ParameterSample &sample)
+{
+	quint32 changed = 0;
+	// Visit the bits set in the mask only, lowest first.
+	for (quint32 mask = sample.mask; mask != 0; mask &= mask - 1) {
+		int parameter = __builtin_ctz(mask);
+		int BatteryController::*member = parameterMember(parameter);
+		if (member == 0 || this->*member == sample.values[parameter])
+			continue;
+		this->*member = sample.values[parameter];
+		changed |= 1u << parameter;
+	}
+	if (changed != 0)
+		emit parametersChanged(changed);
+}
+
+int BatteryController::*BatteryController::parameterMember(int parameter)
+{
+	switch (parameter) {
+	case ::BattVolts: return &BatteryController::mBattVolts;
+	case ::BussVolts: return &BatteryController::mBussVolts;
+	case ::BattAmps: return &BatteryController::mBattAmps;
+	case ::BussAmps: return &BatteryController::mBussAmps;
+	case ::BattTemp: return &BatteryController::mBattTemp;
+	case ::AirTemp: return &BatteryController::mAirTemp;
+	case ::SOC: return &BatteryController::mSOC;
+	case ::SOC_AmpHrs: return &BatteryController::mSOCAmpHrs;
+	case ::StsRegWarning: return &BatteryController::mStsRegWarning;
+	case ::StsRegSummary: return &BatteryController::mStsRegSummary;
+	case ::StsRegHardwareFailure:
+		return &BatteryController::mStsRegHardwareFailure;
+	case ::StsRegOperationalFailure:
+		return &BatteryController::mStsRegOperationalFailure;
+	case ::StsRegOperationalMode:
+		return &BatteryController::mStsRegOperationalMode;
+	case ::HealthIndication: return &BatteryController::mHealthIndication;
+	case ::ZBMState: return &BatteryController::mState;
+	case ::DeviceAddress: return &BatteryController::mDeviceAddress;
+	case ::ClearStatusRegisterFlags:
+		return &BatteryController::mClearStatusRegisterFlags;
+	case ::EnableSelfMaintenanceAtTheEndOfDischarge:
+		return &BatteryController::mEnableSelfMaintenanceAtTheEndOfDischarge;
+	case ::EnterRunCommand: return &BatteryController::mEnterRunCommand;
+	case ::SelfDischargeAndMaintenanceCycle:
+		return &BatteryController::mSelfDischargeAndMaintenanceCycle;
+	default: return 0;
+	}
+}
+
 QString BatteryController::productName() const
 {
 	return "ZBM";
@@ -96,6 +149,11 @@ QString BatteryController::portName() const
 	return mPortName;
 }
 
+int BatteryController::slaveAddress() const
+{
+	return mSlaveAddress;
+}
+
 QString BatteryController::serial() const
 {
 	return mSerial;
@@ -366,6 +424,9 @@ void BatteryController::setClearStatusRegisterFlags(int t)
 	mClearStatusRegisterFlags = t;
 	
 	emit clearStatusRegisterFlagsChanged();	 
+	// Enumerator names are qualified, because the getters of this class use
+	// the same names.
+	emit writeRequested(::ClearStatusRegisterFlags, t);
 }
 
 int BatteryController::RequestDelayedSelfMaintenance() const
@@ -380,6 +441,7 @@ QLOG_INFO() << "DELAYED STRIP";
 		return;
 	mRequestDelayedSelfMaintenance = t;
 	emit requestDelayedSelfMaintenanceChanged();	 
+	emit writeRequested(::EnableSelfMaintenanceAtTheEndOfDischarge, t);
 }
 
 int BatteryController::SetOperationalMode() const
@@ -408,6 +470,7 @@ QLOG_INFO() << "IMMEDIATE STRIP";
 		return;
 	mRequestImmediateSelfMaintenance = t;
 	emit requestImmediateSelfMaintenanceChanged();	 
+	emit writeRequested(::SelfDischargeAndMaintenanceCycle, t);
 }
 
 int BatteryController::EnableSelfMaintenanceAtTheEndOfDischarge() const
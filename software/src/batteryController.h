@@ -14,6 +14,59 @@ enum ConnectionState {
 
 Q_DECLARE_METATYPE(ConnectionState)
 
+/*!
+ * Values retrieved from (or written to) the registers of a ZBM.
+ */
+enum ParameterType {
+	None,
+	BattVolts,
+	BussVolts,
+	BattAmps,
+	BussAmps,
+	BattTemp,
+	AirTemp,
+	SOC,
+	SOC_AmpHrs,
+	StsRegWarning,
+	StsRegSummary,
+	StsRegHardwareFailure,
+	StsRegOperationalFailure,
+	NotUsed,
+	StsRegOperationalMode,
+	HealthIndication,
+	ZBMState,
+	DeviceAddress,
+	ClearStatusRegisterFlags,
+	EnableSelfMaintenanceAtTheEndOfDischarge,
+	EnterRunCommand,
+	SelfDischargeAndMaintenanceCycle,
+	ParameterCount
+};
+
+/*!
+ * Values of several parameters, retrieved from the device at once.
+ * Bit n of `mask` is set if `values[n]` holds the value of parameter n (see
+ * `ParameterType`).
+ */
+struct ParameterSample
+{
+	ParameterSample():
+		mask(0)
+	{
+	}
+
+	void set(ParameterType parameter, int value)
+	{
+		mask |= 1u << parameter;
+		values[parameter] = value;
+	}
+
+	quint32 mask;
+	int values[ParameterCount];
+};
+
+Q_DECLARE_METATYPE(ParameterSample)
+
 
 class BatteryController : public QObject
 {
@@ -81,8 +134,6 @@ public:
 
 	ConnectionState connectionState() const;
 
-	void setConnectionState(ConnectionState state);
-
 	/*!
 	 * Returns the device type as reported by the energy meter.
 	 */
@@ -102,12 +153,8 @@ public:
 
 	QString serial() const;
 
-	void setSerial(const QString &s);
-
 	int firmwareVersion() const;
 
-	void setFirmwareVersion(int v);
-
 	double BattVolts() const;
 
 	void setBattVolts(int t);
@@ -191,7 +238,43 @@ public:
 	 */
 	QString portName() const;
 
+	/*!
+	 * Returns the slave address used to communicate with the battery. Unlike
+	 * `DeviceAddress`, this value is set on construction and is never
+	 * changed by the data read from the device.
+	 */
+	int slaveAddress() const;
+
+public slots:
+	void setConnectionState(ConnectionState state);
+
+	void setSerial(const QString &s);
+
+	void setFirmwareVersion(int v);
+
+	/*!
+	 * Stores all values in `sample`.
+	 * The updater runs in the thread of its Modbus connection, and passes the
+	 * values to this object (which lives in the main thread) using queued
+	 * calls of this slot. The notify signals of the properties are not
+	 * emitted. Instead, `parametersChanged` is emitted once for all values
+	 * that have changed.
+	 */
+	void setParameters(const ParameterSample &sample);
+
 signals:
+	/*!
+	 * Emitted by `setParameters`. Bit n of `changed` is set if the value of
+	 * parameter n (see `ParameterType`) has changed.
+	 */
+	void parametersChanged(quint32 changed);
+
+	/*!
+	 * Emitted when a value that should be written to the device has been
+	 * changed (eg. from the D-Bus).
+	 */
+	void writeRequested(int parameter, int value);
+
 	void connectionStateChanged();
 
 	void deviceTypeChanged();
@@ -205,12 +288,19 @@ signals:
 	void errorCodeChanged();
 
 private:
+	/*!
+	 * Returns the member holding the (raw) value of `parameter`, or 0 if
+	 * the parameter is not stored.
+	 */
+	static int BatteryController::*parameterMember(int parameter);
+
 	ConnectionState mConnectionState;
 	int mDeviceType;
 	int mDeviceSubType;
 	int mErrorCode;
 	int mFirmwareVersion;
 	QString mPortName;
+	int mSlaveAddress;
 	QString mSerial;
 	int mBattVolts;
 	int mBussVolts;
@@ -238,4 +328,6 @@ private:
 	int mSelfDischargeAndMaintenanceCycle;	
 };
 
+Q_DECLARE_METATYPE(BatteryController *)
+
 #endif // BATTERY_CONTROLLER_H
@@ -11,6 +11,9 @@
 #include "version.h"
 #define VE_PROD_ID_REDFLOW_ZBM2 0xB003
 
+// Number of device instances reserved for /dev/ttyO* and /dev/ttyUSB* ports
+static const int InstancesPerSlave = 64;
+
 
 BatteryControllerBridge::BatteryControllerBridge(BatteryController *BatteryController,
 							   BatteryControllerSettings *emSettings,
@@ -18,7 +21,8 @@ BatteryControllerBridge::BatteryControllerBridge(BatteryController *BatteryContr
 							   QObject *parent,
 							   BatteryControllerUpdater *BatteryControllerUpdater) :
 	DBusBridge(parent),
-	mBatteryController(BatteryController)
+	mBatteryController(BatteryController),
+	mSettings(settings)
 {
 
 	connect(BatteryController, SIGNAL(destroyed()), this, SLOT(deleteLater()));
@@ -48,6 +52,13 @@ BatteryControllerBridge::BatteryControllerBridge(BatteryController *BatteryContr
 	int deviceInstance = getDeviceInstance(portName, "/dev/ttyUSB", 288);
 	if (deviceInstance == -1)
 		deviceInstance = getDeviceInstance(portName, "/dev/ttyO", 256);
+	// Multiple batteries may share the same port. The instances of all ports
+	// (256-319) are repeated for each slave address, so slave 1 keeps the
+	// instance of a single battery setup. With at most 31 slaves on a bus,
+	// the instances range from 256 to 2239.
+	if (deviceInstance != -1)
+		deviceInstance += (BatteryController->slaveAddress() - 1) *
+				InstancesPerSlave;
 	produce("/Mgmt/Connection", portName);
 	produce("/DeviceInstance", deviceInstance);
 	produce("/Capabilities", "Redflow,IntegratedSoc");
@@ -55,6 +66,9 @@ BatteryControllerBridge::BatteryControllerBridge(BatteryController *BatteryContr
 	produce("/Serial", serial);
 
 	produceBatteryInfo(BatteryController, "");
+	onPublishPolicyChanged();
+	connect(settings, SIGNAL(publishPolicyChanged()),
+			this, SLOT(onPublishPolicyChanged()));
 
 	registerService();
 }
@@ -93,9 +107,61 @@ void BatteryControllerBridge::produceBatteryInfo(BatteryController *bc, const QS
 	produce(bc, "RequestDelayedSelfMaintenance", path + "/RequestDelayedSelfMaintenance", "", 0);
 	produce(bc, "SetOperationalMode", path + "/SetOperationalMode", "", 0);
 	produce(bc, "RequestImmediateSelfMaintenance", path + "/RequestImmediateSelfMaintenance", "", 0);
-	
+
+	// Values retrieved from the battery do not trigger the notify signals of
+	// the properties above. They are reported in groups instead.
+	addParameterPath(BattAmps, path + "/Dc/0/Current");
+	addParameterPath(BattVolts, path + "/Dc/0/Voltage");
+	addParameterPath(BattAmps, path + "/Dc/0/Power");
+	addParameterPath(BattVolts, path + "/Dc/0/Power");
+	addParameterPath(BattTemp, path + "/Dc/0/Temperature");
+	addParameterPath(SOC, path + "/Soc");
+	addParameterPath(StsRegSummary, path + "/StsRegSummary");
+	addParameterPath(StsRegHardwareFailure, path + "/StsRegHardwareFailure");
+	addParameterPath(StsRegOperationalFailure, path + "/StsRegOperationalFailure");
+	addParameterPath(StsRegWarning, path + "/StsRegWarning");
+	addParameterPath(StsRegOperationalMode, path + "/StsRegOperationalMode");
+	addParameterPath(SOC_AmpHrs, path + "/SOCAmpHrs");
+	addParameterPath(AirTemp, path + "/AirTemp");
+	addParameterPath(HealthIndication, path + "/HealthIndication");
+	addParameterPath(BussVolts, path + "/BussVolts");
+	addParameterPath(ZBMState, path + "/State");
+	addParameterPath(DeviceAddress, path + "/DeviceAddress");
+	addParameterPath(ClearStatusRegisterFlags, path + "/ClearStatusRegisterFlags");
+	connect(bc, SIGNAL(parametersChanged(quint32)),
+			this, SLOT(onParametersChanged(quint32)), Qt::UniqueConnection);
+}
+
+void BatteryControllerBridge::onParametersChanged(quint32 changed)
+{
+	for (; changed != 0; changed &= changed - 1) {
+		foreach (const QString &path, mParameterPaths[__builtin_ctz(changed)])
+			setChanged(path);
+	}
 }
 
+void BatteryControllerBridge::addParameterPath(ParameterType parameter,
+											   const QString &path)
+{
+	mParameterPaths[parameter].append(path);
+}
+
+
+void BatteryControllerBridge::onPublishPolicyChanged()
+{
+	PublishPolicy policy;
+	policy.relativeDeadband = mSettings->relativeDeadband();
+	policy.minInterval = mSettings->publishMinInterval();
+	policy.maxStaleness = mSettings->publishMaxStaleness();
+	setPublishPolicy("/Dc/0/Temperature", policy);
+	setPublishPolicy("/Soc", policy);
+	policy.absoluteDeadband = mSettings->currentDeadband();
+	setPublishPolicy("/Dc/0/Current", policy);
+	policy.absoluteDeadband = mSettings->voltageDeadband();
+	setPublishPolicy("/Dc/0/Voltage", policy);
+	policy.absoluteDeadband = mSettings->powerDeadband();
+	setPublishPolicy("/Dc/0/Power", policy);
+}
 
 bool BatteryControllerBridge::fromDBus(const QString &path, QVariant &value)
 {
@@ -3,10 +3,11 @@
 
 #include <QPointer>
 #include <QString>
+#include <QStringList>
+#include "batteryController.h"
 #include "dbus_bridge.h"
 #include "dbus_redflow.h"
 
-class BatteryController;
 class BatteryControllerSettings;
 class Settings;
 
@@ -28,6 +29,11 @@ public:
 public slots:
 	void produceBatteryInfo(BatteryController *bc, const QString &path);
 
+private slots:
+	void onPublishPolicyChanged();
+
+	void onParametersChanged(quint32 changed);
+
 protected:
 	virtual bool toDBus(const QString &path, QVariant &value);
 
@@ -37,7 +43,16 @@ private:
 	int getDeviceInstance(const QString &path, const QString &prefix,
 						  int instanceBase);
 
+	/*!
+	 * Publishes `path` when the value of `parameter` changes (see
+	 * `BatteryController::parametersChanged`).
+	 */
+	void addParameterPath(ParameterType parameter, const QString &path);
+
 	BatteryController *mBatteryController;
+	Settings *mSettings;
+	// D-Bus paths depending on each parameter
+	QStringList mParameterPaths[ParameterCount];
 };
 
 #endif // BATTERY_CONTROLLER_BRIDGE_H
@@ -0,0 +1,127 @@
+#include <QsLog.h>
+#include <QTimer>
+#include "battery_controller_scanner.h"
+
+static const int RegDevice = 0x000D;
+static const int RescanInterval = 60 * 1000; // 60 seconds in ms
+// Used when a battery has not been found at a preferred address
+static const int PreferredRescanInterval = 5 * 1000;
+
+BatteryControllerScanner::BatteryControllerScanner(ModbusRtu *modbus,
+												   int firstAddress,
+												   int lastAddress,
+												   QObject *parent):
+	QObject(parent),
+	mModbus(modbus),
+	mRescanTimer(new QTimer(this)),
+	mFirstAddress(firstAddress),
+	mLastAddress(lastAddress)
+{
+	Q_ASSERT(mModbus != 0);
+	Q_ASSERT(firstAddress <= lastAddress);
+	connect(mModbus, SIGNAL(readCompleted(int, quint8, const RegisterSpan &)),
+			this, SLOT(onReadCompleted(int, quint8, RegisterSpan)));
+	connect(mModbus, SIGNAL(errorReceived(int, quint8, int)),
+			this, SLOT(onErrorReceived(int, quint8, int)));
+	connect(mRescanTimer, SIGNAL(timeout()), this, SLOT(onRescanTimer()));
+	mRescanTimer->setSingleShot(true);
+}
+
+void BatteryControllerScanner::start()
+{
+	if (isScanning())
+		return;
+	mRescanTimer->stop();
+	foreach (int address, mPreferredAddresses) {
+		if (isMissing(address))
+			mQueue.append(address);
+	}
+	for (int address=mFirstAddress; address<=mLastAddress; ++address) {
+		if (isMissing(address) && !mQueue.contains(address))
+			mQueue.append(address);
+	}
+	probeNext();
+}
+
+void BatteryControllerScanner::setPreferredAddresses(const QList<int> &addresses)
+{
+	mPreferredAddresses = addresses;
+	if (!isScanning()) {
+		foreach (int address, addresses) {
+			if (isMissing(address)) {
+				start();
+				return;
+			}
+		}
+		return;
+	}
+	// Move the preferred addresses to the front of the current scan.
+	for (int i=addresses.size() - 1; i>=0; --i) {
+		if (mQueue.removeOne(addresses[i]))
+			mQueue.prepend(addresses[i]);
+	}
+}
+
+void BatteryControllerScanner::onReadCompleted(int function, quint8 addr,
+											   const RegisterSpan &registers)
+{
+	Q_UNUSED(function)
+	Q_UNUSED(registers)
+	if (!mProbing.removeOne(addr))
+		return;
+	QLOG_INFO() << "Battery controller found at slave address" << addr;
+	mFoundAddresses.append(addr);
+	emit deviceFound(addr);
+	probeNext();
+}
+
+void BatteryControllerScanner::onErrorReceived(int errorType, quint8 addr,
+											   int exception)
+{
+	Q_UNUSED(errorType)
+	Q_UNUSED(exception)
+	if (!mProbing.removeOne(addr))
+		return;
+	probeNext();
+}
+
+void BatteryControllerScanner::onRescanTimer()
+{
+	start();
+}
+
+void BatteryControllerScanner::probeNext()
+{
+	// Only as many addresses as the connection can handle at once are
+	// probed, so the scan does not flood the queue in `ModbusRtu`. Updaters
+	// for batteries found earlier will keep polling while the scan continues.
+	while (!mQueue.isEmpty() && mProbing.size() < mModbus->maxInFlight()) {
+		int address = mQueue.takeFirst();
+		if (!isMissing(address))
+			continue;
+		mProbing.append(address);
+		mModbus->readRegisters(ModbusRtu::ReadHoldingRegisters, address,
+							   RegDevice, 1, ModbusRtu::StatusPriority);
+	}
+	if (isScanning())
+		return;
+	bool preferredMissing = false;
+	foreach (int address, mPreferredAddresses)
+		preferredMissing = preferredMissing || isMissing(address);
+	if (preferredMissing) {
+		mRescanTimer->start(PreferredRescanInterval);
+	} else if (mFoundAddresses.size() < mLastAddress - mFirstAddress + 1) {
+		mRescanTimer->start(RescanInterval);
+	}
+}
+
+bool BatteryControllerScanner::isScanning() const
+{
+	return !mQueue.isEmpty() || !mProbing.isEmpty();
+}
+
+bool BatteryControllerScanner::isMissing(int address) const
+{
+	return address >= mFirstAddress && address <= mLastAddress &&
+		!mFoundAddresses.contains(address);
+}
@@ -0,0 +1,76 @@
+#ifndef BATTERY_CONTROLLER_SCANNER_H
+#define BATTERY_CONTROLLER_SCANNER_H
+
+#include <QList>
+#include <QObject>
+#include "modbus_rtu.h"
+
+class QTimer;
+
+/*!
+ * Searches a range of slave addresses on a single Modbus connection for
+ * battery controllers.
+ * Addresses are probed by reading the device register. If the connection
+ * supports pipelining (Modbus TCP), several addresses are probed at once.
+ * Preferred addresses (where batteries have been found before) are probed
+ * first. The `deviceFound` signal is raised for each slave that responds.
+ * Found addresses will not be probed again. If some addresses did not respond
+ * during a scan, a new scan of those addresses will be started after a
+ * while, so batteries which are powered up later will still be detected.
+ * The new scan starts sooner if a preferred address is missing.
+ */
+class BatteryControllerScanner : public QObject
+{
+	Q_OBJECT
+public:
+	/*!
+	 * Creates a scanner for the slave addresses `firstAddress` up to and
+	 * including `lastAddress`.
+	 * @param modbus. The modbus connection object. This object may be shared
+	 * with `BatteryControllerUpdater` objects. The `modbus` object will not
+	 * be deleted in the destructor.
+	 */
+	BatteryControllerScanner(ModbusRtu *modbus, int firstAddress,
+							 int lastAddress, QObject *parent = 0);
+
+	/*!
+	 * Starts a new scan of all addresses that have not been found yet.
+	 */
+	void start();
+
+	/*!
+	 * Sets the addresses that should be probed before all others. If one of
+	 * them has not been found yet, it will be probed right away.
+	 */
+	void setPreferredAddresses(const QList<int> &addresses);
+
+signals:
+	void deviceFound(int slaveAddress);
+
+private slots:
+	void onReadCompleted(int function, quint8 addr, const RegisterSpan &registers);
+
+	void onErrorReceived(int errorType, quint8 addr, int exception);
+
+	void onRescanTimer();
+
+private:
+	void probeNext();
+
+	bool isScanning() const;
+
+	bool isMissing(int address) const;
+
+	ModbusRtu *mModbus;
+	QTimer *mRescanTimer;
+	int mFirstAddress;
+	int mLastAddress;
+	// Addresses which still have to be probed during the current scan
+	QList<int> mQueue;
+	// Addresses waiting for a reply
+	QList<int> mProbing;
+	QList<int> mPreferredAddresses;
+	QList<int> mFoundAddresses;
+};
+
+#endif // BATTERY_CONTROLLER_SCANNER_H
@@ -2,10 +2,9 @@
 #include <QsLog.h>
 #include <QTimer>
 #include "batteryController.h"
-#include "battery_controller_settings.h"
 #include "battery_controller_updater.h"
-#include "battery_controller_bridge.h"
 #include "modbus_rtu.h"
+#include "sample_trace.h"
 
 #define MODBUSREG_CLEAR_STATUS_REGISTER_FLAGS 					0x9031
 #define MODBUSREG_ENABLE_SELF_MAINTENANCE_END_OF_DISCHARGE 		0x9032
@@ -13,80 +12,106 @@
 
 
 
-static const int MaxAcquisitionIndex = 1;
 static const int MaxRegCount = 6;
 static const int MaxTimeoutCount = 5;
-
-static const int ConnectionLostWaitInterval = 60 * 1000;  // 60 seconds in ms
+// Maximum number of registers in a single ReadHoldingRegisters request
+static const int MaxReadCount = 125;
+// Maximum number of unused registers between 2 commands that will be read
+// in order to merge the commands into a single request.
+static const int MaxReadGap = 8;
+// Commands due within this time (ms) are read along with the commands that
+// are due now, so they share a request.
+static const int ScheduleTolerance = 100;
+static const int DefaultTelemetryInterval = 1000;
+static const int DefaultStatusInterval = 30000;
+
+// Time (ms) before trying to restore a lost connection. The time is doubled
+// after each failed attempt.
+static const int MinReconnectInterval = 1000;
+static const int MaxReconnectInterval = 60 * 1000;
 static const int UpdateSettingsInterval = 10 * 60 * 1000; // 10 minutes in ms
 
-enum ParameterType {
-	None,
-	BattVolts,
-	BussVolts,
-	BattAmps,
-	BussAmps,
-	BattTemp,
-	AirTemp,
-	SOC,
-	SOC_AmpHrs,
-	StsRegWarning,
-	StsRegSummary,
-	StsRegHardwareFailure,
-	StsRegOperationalFailure,
-	NotUsed,
-	StsRegOperationalMode,
-	HealthIndication,
-	ZBMState,
-	DeviceAddress,
-	ClearStatusRegisterFlags,
-	EnableSelfMaintenanceAtTheEndOfDischarge,
-	EnterRunCommand,
-	SelfDischargeAndMaintenanceCycle
-};
-
 struct RegisterCommand {
 	int regOffset;
 	ParameterType action;
 };
 
+/*!
+ * A group of adjacent registers, read with a single request.
+ * The base interval of the group is the telemetry or status interval (see
+ * `BatteryControllerUpdater::setPollIntervals`), depending on `priority`.
+ * When the values do not change, the interval is doubled on each read, up to
+ * `maxBackOff` times the base interval.
+ */
 struct CompositeCommand {
 	int reg;
-	int inverval;
+	int maxBackOff;
+	ModbusRtu::Priority priority;
 	RegisterCommand actions[MaxRegCount];
 };
 
+// Commands must be sorted by register, so adjacent commands can be merged into
+// a single request.
+// The alarm block is polled with the telemetry, so alarms are reported within
+// 4 telemetry intervals (4 s by default) even when nothing changes.
 static const CompositeCommand ZBMCommands[] = {
-	{ 0x9011, 0, { { 0, SOC }, { 1, SOC_AmpHrs }, { 2, BattVolts }, { 3, BattAmps }, { 4, BattTemp }, { 5, AirTemp } } },
-	{ 0x9001, 0, { { 0, StsRegSummary }, { 1, StsRegHardwareFailure }, { 2, StsRegOperationalFailure }, { 3, StsRegWarning }, { 4, NotUsed }, { 5, NotUsed } } },
-	{ 0x9008, 0, { { 0, StsRegOperationalMode }, { 1, NotUsed }, { 2, NotUsed }, { 3, NotUsed }, { 4, NotUsed }, { 5, NotUsed } } },
-	{ 0x9017, 0, { { 0, HealthIndication }, { 1, BussVolts }, { 2, ZBMState }, { 3, NotUsed }, { 4, NotUsed }, { 5, NotUsed } } } ,		
-	{ 0x9030, 0, { { 0, DeviceAddress }, { 1, ClearStatusRegisterFlags }, { 2, EnableSelfMaintenanceAtTheEndOfDischarge }, { 3, EnterRunCommand }, { 4, SelfDischargeAndMaintenanceCycle }, { 5, NotUsed } } }		
+	{ 0x9001, 4, ModbusRtu::TelemetryPriority, { { 0, StsRegSummary }, { 1, StsRegHardwareFailure }, { 2, StsRegOperationalFailure }, { 3, StsRegWarning }, { 4, NotUsed }, { 5, NotUsed } } },
+	{ 0x9008, 2, ModbusRtu::StatusPriority, { { 0, StsRegOperationalMode }, { 1, NotUsed }, { 2, NotUsed }, { 3, NotUsed }, { 4, NotUsed }, { 5, NotUsed } } },
+	{ 0x9011, 1, ModbusRtu::TelemetryPriority, { { 0, SOC }, { 1, SOC_AmpHrs }, { 2, BattVolts }, { 3, BattAmps }, { 4, BattTemp }, { 5, AirTemp } } },
+	{ 0x9017, 8, ModbusRtu::TelemetryPriority, { { 0, HealthIndication }, { 1, BussVolts }, { 2, ZBMState }, { 3, NotUsed }, { 4, NotUsed }, { 5, NotUsed } } },
+	{ 0x9030, 4, ModbusRtu::StatusPriority, { { 0, DeviceAddress }, { 1, ClearStatusRegisterFlags }, { 2, EnableSelfMaintenanceAtTheEndOfDischarge }, { 3, EnterRunCommand }, { 4, SelfDischargeAndMaintenanceCycle }, { 5, NotUsed } } }
 };
 
 static const int ZBMCommandCount = sizeof(ZBMCommands) / sizeof(ZBMCommands[0]);
 
+/*!
+ * Returns the number of registers needed to retrieve all used values of
+ * `cmd`. Trailing `NotUsed` registers are not included.
+ */
+static int commandSpan(const CompositeCommand &cmd)
+{
+	int span = 0;
+	for (int i=0; i<MaxRegCount; ++i) {
+		const RegisterCommand &ra = cmd.actions[i];
+		if (ra.action == None)
+			break;
+		if (ra.action != NotUsed)
+			span = qMax(span, ra.regOffset + 1);
+	}
+	return span;
+}
+
 
 BatteryControllerUpdater::BatteryControllerUpdater(BatteryController *mBatteryController, ModbusRtu *modbus, QObject *parent):
 	QObject(parent),
-	mSettings(0),
 	mModbus(0),
 	mAcquisitionTimer(new QTimer(this)),
 	mSettingsUpdateTimer(new QTimer(this)),
 	mTimeoutCount(0),
 	mSetupRequested(false),
 	mApplication(0),
-	mState(DeviceId),
+	mState(Identify),
 	mCommands(0),
 	mCommandCount(0),
-	mCommandIndex(0),
-	mAcquisitionIndex(0),
+	mBlockIndex(0),
+	mMaxReadGap(MaxReadGap),
+	mTelemetryInterval(DefaultTelemetryInterval),
+	mStatusInterval(DefaultStatusInterval),
+	mAlarm(false),
+	mZbmState(-1),
+	mCombinedIdentify(true),
+	mReconnectInterval(MinReconnectInterval),
 	mBatteryController(mBatteryController)
 {
 	Q_ASSERT(mBatteryController != 0);
+	// The controller lives in another thread, so its address is copied here.
+	mSlaveAddress = mBatteryController->slaveAddress();
 	mModbus = modbus;
-	connect(mModbus, SIGNAL(readCompleted(int, quint8, const QList<quint16> &)),
-			this, SLOT(onReadCompleted(int, quint8, QList<quint16>)));
+	ModbusCounters *counters = mModbus->counters();
+	if (counters != 0)
+		counters->targetPollInterval[mSlaveAddress] = mTelemetryInterval;
+	connect(mModbus, SIGNAL(readCompleted(int, quint8, const RegisterSpan &)),
+			this, SLOT(onReadCompleted(int, quint8, RegisterSpan)));
 	connect(mModbus, SIGNAL(writeCompleted(int, quint8, quint16, quint16)),
 			this, SLOT(onWriteCompleted(int, quint8, quint16, quint16)));
 	connect(mModbus, SIGNAL(errorReceived(int, quint8, int)),
@@ -98,12 +123,8 @@ BatteryControllerUpdater::BatteryControllerUpdater(BatteryController *mBatteryCo
 
 	/*  signals from color control */
 
-	connect(mBatteryController, SIGNAL(clearStatusRegisterFlagsChanged()),
-		this, SLOT(onClearStatusRegisterFlagsChanged()));
-	connect(mBatteryController, SIGNAL(requestDelayedSelfMaintenanceChanged()),
-		this, SLOT(onRequestDelayedSelfMaintenanceChanged()));
-	connect(mBatteryController, SIGNAL(requestImmediateSelfMaintenaceChanged()),
-		this, SLOT(onRequestImmediateSelfMaintenanceChanged()));
+	connect(mBatteryController, SIGNAL(writeRequested(int, int)),
+		this, SLOT(onWriteRequested(int, int)));
 
 
 	mSettingsUpdateTimer->setInterval(UpdateSettingsInterval);
@@ -113,41 +134,76 @@ BatteryControllerUpdater::BatteryControllerUpdater(BatteryController *mBatteryCo
 	startNextAction();
 }
 
-BatteryControllerSettings *BatteryControllerUpdater::settings()
-{
-	return mSettings;
-}
-
 void BatteryControllerUpdater::onErrorReceived(int errorType, quint8 addr, int exception)
 {
-	if (addr != mBatteryController->DeviceAddress())
+	if (addr != mSlaveAddress)
 		return;
 
 	if (errorType == ModbusRtu::Timeout) {
 		if (mTimeoutCount == MaxTimeoutCount) {
-			if (!mBatteryController->serial().isEmpty()) {
+			if (!mSerial.isEmpty()) {
 				QLOG_ERROR() << "Lost connection to battery controller";
 			}
 			mState = WaitOnConnectionLost;
-			delete mSettings;
-			mSettings = 0;
 			mTimeoutCount = MaxTimeoutCount - 1;
-			mBatteryController->setSerial(QString());
-			mBatteryController->setConnectionState(Disconnected);
+			// Read all registers as soon as the connection is restored.
+			resetSchedule();
+			setSerial(QString());
+			setConnectionState(Disconnected);
 		} else {
 			++mTimeoutCount;
 		}
+	} else if (errorType == ModbusRtu::Exception &&
+			   exception == ModbusRtu::IllegalDataAddress &&
+			   mState == Acquisition && mMaxReadGap > 0) {
+		// The device does not allow reading the unused registers between
+		// commands. Restart the acquisition without merging over gaps.
+		QLOG_WARN() << "Merged register read rejected, disabling gap reads";
+		mMaxReadGap = 0;
+		mBlockIndex = 0;
+	} else if (errorType == ModbusRtu::Exception && mState == Identify) {
+		// Read the identification registers one by one instead.
+		QLOG_WARN() << "Combined identification read rejected";
+		mCombinedIdentify = false;
+		mState = DeviceId;
+	} else if (errorType == ModbusRtu::Exception && mState == CheckSetup) {
+		// Devices without setup registers: skip the check instead of
+		// retrying it forever.
+		QLOG_WARN() << "Setup registers not available";
+		mState = Acquisition;
 	}
 	startNextAction();
 }
 
 void BatteryControllerUpdater::onReadCompleted(int function, quint8 addr,
-										 const QList<quint16> &registers)
+										 const RegisterSpan &registers)
 {
-	if (addr != mBatteryController->DeviceAddress())
+	if (addr != mSlaveAddress)
 		return;
 	Q_UNUSED(function)
 	switch (mState) {
+	case Identify:
+	{
+		if (registers.size() != IdentifyCount) {
+			// The reply does not contain all requested registers, so the
+			// offsets below would be out of range.
+			QLOG_WARN() << "Unexpected identification reply size:"
+						<< registers.size();
+			mCombinedIdentify = false;
+			mState = DeviceId;
+			break;
+		}
+		int offset = RegSerial - RegFirmwareVersion;
+		QLOG_INFO() << "EquipmentId:" << registers[RegDevice - RegFirmwareVersion];
+		setSerial(toSerial(registers[offset], registers[offset + 1]));
+		QLOG_INFO() << "Serial number:" << registers[offset]
+					<< registers[offset + 1];
+		QMetaObject::invokeMethod(mBatteryController, "setFirmwareVersion",
+								  Q_ARG(int, registers[0]));
+		QLOG_INFO() << "FirmwareVersion: " << registers[0] << registers[1];
+		mState = WaitForStart;
+		break;
+	}
 	case DeviceId:
 		QLOG_INFO() << "EquipmentId:" << registers[0];
 		//mBatteryController->setDeviceType(registers[0]);
@@ -161,17 +217,14 @@ void BatteryControllerUpdater::onReadCompleted(int function, quint8 addr,
 	case Serial:
 	{
 
-		QString serial;
-			
-		serial = QString::number(((registers[0]<<16)&0xffff) + registers[1]);
-
-		mBatteryController->setSerial(serial);
+		setSerial(toSerial(registers[0], registers[1]));
 		QLOG_INFO() << "Serial number:" << registers[0] << registers[1];
 		mState = FirmwareVersion;
 		break;
 	}
 	case FirmwareVersion:
-		mBatteryController->setFirmwareVersion(registers[0]);
+		QMetaObject::invokeMethod(mBatteryController, "setFirmwareVersion",
+								  Q_ARG(int, registers[0]));
 		QLOG_INFO() << "FirmwareVersion: " << registers[0] << registers[1];
 		mState = WaitForStart;
 		break;
@@ -185,15 +238,17 @@ void BatteryControllerUpdater::onReadCompleted(int function, quint8 addr,
 		mState = registers[0] == 0x01 ? Acquisition : SetMeasurementMode;
 		break;
 	case Acquisition:
-		processAcquisitionData(registers);
-		++mCommandIndex;
+		if (mBlockIndex < mReadBlocks.size()) {
+			processAcquisitionData(mReadBlocks[mBlockIndex], registers);
+			++mBlockIndex;
+		}
 		break;
 	case Wait:
 		mState = Acquisition;
 		break;
 	default:
 		QLOG_ERROR() << "Unknown updater state" << mState;
-		mState = mSettings == 0 ? DeviceId : Acquisition;
+		mState = mSerial.isEmpty() ? identifyState() : Acquisition;
 		break;
 	}
 	mTimeoutCount = 0;
@@ -203,7 +258,7 @@ void BatteryControllerUpdater::onReadCompleted(int function, quint8 addr,
 void BatteryControllerUpdater::onWriteCompleted(int function, quint8 addr,
 										  quint16 address, quint16 value)
 {
-	if (addr != mBatteryController->DeviceAddress())
+	if (addr != mSlaveAddress)
 		return;
 	Q_UNUSED(function)
 	Q_UNUSED(address)
@@ -239,11 +294,10 @@ void BatteryControllerUpdater::onWaitFinished()
 {
 	switch (mState) {
 	case Wait:
-		mStopwatch.restart();
 		mState = Acquisition;
 		break;
 	case WaitOnConnectionLost:
-		mState = DeviceId;
+		mState = identifyState();
 		break;
 	default:
 		mState = 
@@ -265,8 +319,12 @@ void BatteryControllerUpdater::startNextAction()
 			mState = CheckSetup;
 	}
 	switch (mState) {
+	case Identify:
+		setConnectionState(Searched);
+		readRegisters(RegFirmwareVersion, IdentifyCount);
+		break;
 	case DeviceId:
-		mBatteryController->setConnectionState(Searched); 
+		setConnectionState(Searched);
 		readRegisters(RegDevice, 1);
 		break;
 	case VersionCode:
@@ -285,11 +343,11 @@ void BatteryControllerUpdater::startNextAction()
 		//writeRegister(RegApplication, ApplicationH);
 		break;
 	case WaitForStart:
-		QLOG_INFO() << "serial == " << mBatteryController->serial();
-		mSettings = new BatteryControllerSettings(mBatteryController->deviceType(),
-											mBatteryController->serial(),
-											mBatteryController);
-		mBatteryController->setConnectionState(Detected);
+		QLOG_DEBUG() << "serial == " << mSerial;
+		mReconnectInterval = MinReconnectInterval;
+		// The settings will be created by `DBusRedflow`, because they must
+		// live in the main thread.
+		setConnectionState(Detected);
 		mSetupRequested = true;
 
 		startNextAction();
@@ -298,14 +356,20 @@ void BatteryControllerUpdater::startNextAction()
 	case Acquisition:
 		mCommands = ZBMCommands;
 		mCommandCount = ZBMCommandCount;
+		if (mSchedule.size() != mCommandCount)
+			resetSchedule();
+		if (mBlockIndex == 0) {
+			planAcquisition();
+			mSweepTimer.start();
+			updatePollStatistics();
+		}
 		startNextAcquisition();
 		break;
 	case Wait:
 	{
-		int sleep = mStopwatch.elapsed();
-		sleep = 250 - sleep;
-		if (sleep > 50) {
-			mAcquisitionTimer->setInterval(/*sleep*/5000);
+		qint64 sleep = nextDueTime() - mStopwatch.elapsed();
+		if (sleep > 0) {
+			mAcquisitionTimer->setInterval(static_cast<int>(sleep));
 			mAcquisitionTimer->start();
 		} else {
 			onWaitFinished();
@@ -313,8 +377,9 @@ void BatteryControllerUpdater::startNextAction()
 		break;
 	}
 	case WaitOnConnectionLost:
-		mAcquisitionTimer->setInterval(ConnectionLostWaitInterval);
+		mAcquisitionTimer->setInterval(mReconnectInterval);
 		mAcquisitionTimer->start();
+		mReconnectInterval = qMin(2 * mReconnectInterval, MaxReconnectInterval);
 		break;
 	case SetAddress:
 		//writeRegister(0x2000, 2);
@@ -329,170 +394,305 @@ void BatteryControllerUpdater::startNextAction()
 
 void BatteryControllerUpdater::startNextAcquisition()
 {
-	const CompositeCommand *cmd = 0;
+	if (mBlockIndex >= mReadBlocks.size()) {
+		ModbusCounters *counters = mModbus->counters();
+		if (counters != 0)
+			counters->sweepTime.add(mSweepTimer.nsecsElapsed() / 1000);
+		mState = Wait;
+		mBlockIndex = 0;
+		setConnectionState(Connected);
+		startNextAction();
+		return;
+	}
+	const ReadBlock &block = mReadBlocks[mBlockIndex];
+	readRegisters(block.reg, block.count, block.priority);
+}
 
-	for (;;) {
-		if (mCommandIndex < mCommandCount)
-			cmd = &mCommands[mCommandIndex];
-		if (cmd !=0 && (cmd->inverval == 0 || mAcquisitionIndex == cmd->inverval)) {
-			break;
-		} else {
-			++mCommandIndex;
-			if (mCommandIndex >= mCommandCount) {
-				mState = Wait;
-				mCommandIndex = 0;
-				++mAcquisitionIndex;
-				if (mAcquisitionIndex == MaxAcquisitionIndex) {
-					mAcquisitionIndex = 0;
-					mBatteryController->setConnectionState(Connected);
-				}
-				startNextAction();
-				return;
+void BatteryControllerUpdater::planAcquisition()
+{
+	// Merge the register ranges of all commands due in this acquisition cycle
+	// into as few requests as possible. Small gaps between the commands are
+	// read as well if that saves a request.
+	mReadBlocks.resize(0);
+	qint64 now = mStopwatch.elapsed();
+	for (int i=0; i<mCommandCount; ++i) {
+		const CompositeCommand &cmd = mCommands[i];
+		if (mSchedule[i].due > now + ScheduleTolerance)
+			continue;
+		int span = commandSpan(cmd);
+		if (span == 0)
+			continue;
+		if (!mReadBlocks.isEmpty()) {
+			ReadBlock &last = mReadBlocks.last();
+			int gap = cmd.reg - (last.reg + last.count);
+			int count = cmd.reg + span - last.reg;
+			if (gap <= mMaxReadGap && count <= MaxReadCount) {
+				last.count = qMax<int>(last.count, count);
+				last.lastCommand = i;
+				last.priority = qMin(last.priority, cmd.priority);
+				continue;
 			}
 		}
+		ReadBlock block;
+		block.reg = cmd.reg;
+		block.count = span;
+		block.firstCommand = i;
+		block.lastCommand = i;
+		block.priority = cmd.priority;
+		mReadBlocks.append(block);
 	}
-	int maxOffset = 0;
-	for (int i=0; i<MaxRegCount; ++i) {
-		const RegisterCommand &ra = cmd->actions[i];
-		if (ra.action == None)
-			break;
-		maxOffset = qMax(maxOffset, ra.regOffset);
-	}
-	readRegisters(cmd->reg, maxOffset + 2);
 }
 
-void BatteryControllerUpdater::readRegisters(quint16 startReg, quint16 count)
+void BatteryControllerUpdater::readRegisters(quint16 startReg, quint16 count,
+											 ModbusRtu::Priority priority)
 {
 	mModbus->readRegisters(ModbusRtu::ReadHoldingRegisters,
-						   mBatteryController->DeviceAddress(), startReg, count);
+						   mSlaveAddress, startReg, count,
+						   priority);
 }
 
 void BatteryControllerUpdater::writeRegister(quint16 reg, quint16 value)
 {
 	mModbus->writeRegister(ModbusRtu::WriteSingleRegister,
-						   mBatteryController->DeviceAddress(), reg, value);
+						   mSlaveAddress, reg, value);
+}
+
+/*!
+ * Returns true if the register holding `action` contains a signed value.
+ */
+static bool isSigned(ParameterType action)
+{
+	switch (action) {
+	case BattAmps:
+	case BussAmps:
+	case BattTemp:
+	case AirTemp:
+	case SOC_AmpHrs:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void BatteryControllerUpdater::processAcquisitionData(const ReadBlock &block,
+													   const RegisterSpan &registers)
+{
+	// All values of the block are passed to the controller at once.
+	ParameterSample sample;
+	for (int i=block.firstCommand; i<=block.lastCommand; ++i) {
+		const CompositeCommand &cmd = mCommands[i];
+		int offset = cmd.reg - block.reg;
+		if (offset + commandSpan(cmd) > registers.size())
+			continue;
+		processAcquisitionData(cmd, offset, registers, sample);
+		updateSchedule(i, offset, registers);
+	}
+	if (sample.mask == 0)
+		return;
+	setParameters(sample);
+	// Poll all registers at their base interval while an alarm is active,
+	// and after each change of the state of the battery.
+	quint32 summaryBit = 1u << StsRegSummary;
+	if ((sample.mask & summaryBit) != 0) {
+		bool alarm = sample.values[StsRegSummary] != 0;
+		if (alarm && !mAlarm)
+			speedUp();
+		mAlarm = alarm;
+	}
+	quint32 stateBit = 1u << ZBMState;
+	if ((sample.mask & stateBit) != 0) {
+		int state = sample.values[ZBMState];
+		if (mZbmState != -1 && state != mZbmState)
+			speedUp();
+		mZbmState = state;
+	}
+}
+
+void BatteryControllerUpdater::updateSchedule(int index, int offset,
+											  const RegisterSpan &registers)
+{
+	const CompositeCommand &cmd = mCommands[index];
+	CommandSchedule &schedule = mSchedule[index];
+	int span = commandSpan(cmd);
+	bool changed = schedule.values.size() != span;
+	schedule.values.resize(span);
+	for (int i=0; i<span; ++i) {
+		quint16 value = registers[offset + i];
+		if (schedule.values[i] != value) {
+			schedule.values[i] = value;
+			changed = true;
+		}
+	}
+	int base = baseInterval(cmd);
+	if (changed || mAlarm)
+		schedule.interval = base;
+	else
+		schedule.interval = qMin(2 * schedule.interval, cmd.maxBackOff * base);
+	// The next read is due one interval after the previous deadline, rather
+	// than after the reply, so time spent waiting for the bus does not add
+	// up. If the deadline was missed by more than an interval, the missed
+	// reads are skipped.
+	qint64 now = mStopwatch.elapsed();
+	schedule.due += schedule.interval;
+	if (schedule.due <= now)
+		schedule.due = now + schedule.interval;
+}
+
+BatteryControllerUpdater::State BatteryControllerUpdater::identifyState() const
+{
+	return mCombinedIdentify ? Identify : DeviceId;
+}
+
+QString BatteryControllerUpdater::toSerial(quint16 high, quint16 low)
+{
+	return QString::number(((high<<16)&0xffff) + low);
+}
+
+int BatteryControllerUpdater::baseInterval(const CompositeCommand &cmd) const
+{
+	return cmd.priority == ModbusRtu::TelemetryPriority ?
+		mTelemetryInterval : mStatusInterval;
+}
+
+void BatteryControllerUpdater::setPollIntervals(int telemetry, int status)
+{
+	if (telemetry == mTelemetryInterval && status == mStatusInterval)
+		return;
+	mTelemetryInterval = telemetry;
+	mStatusInterval = status;
+	ModbusCounters *counters = mModbus->counters();
+	if (counters != 0)
+		counters->targetPollInterval[mSlaveAddress] = telemetry;
+	// Apply the new intervals right away, instead of waiting for the next
+	// read of each command.
+	qint64 now = mStopwatch.elapsed();
+	for (int i=0; i<mSchedule.size(); ++i) {
+		CommandSchedule &schedule = mSchedule[i];
+		schedule.interval = baseInterval(mCommands[i]);
+		schedule.due = qMin(schedule.due, now + schedule.interval);
+	}
+	if (mState == Wait && mAcquisitionTimer->isActive()) {
+		mAcquisitionTimer->stop();
+		startNextAction();
+	}
+}
+
+void BatteryControllerUpdater::updatePollStatistics()
+{
+	// The achieved interval is measured between the starts of the
+	// acquisition cycles containing telemetry.
+	bool telemetry = false;
+	foreach (const ReadBlock &block, mReadBlocks)
+		telemetry = telemetry || block.priority == ModbusRtu::TelemetryPriority;
+	if (!telemetry)
+		return;
+	ModbusCounters *counters = mModbus->counters();
+	if (counters != 0 && mTelemetryTimer.isValid()) {
+		int interval = static_cast<int>(mTelemetryTimer.elapsed());
+		int average = counters->pollInterval[mSlaveAddress];
+		// Exponential moving average, so a single late cycle does not
+		// dominate the result.
+		counters->pollInterval[mSlaveAddress] = average == 0 ?
+			interval : (3 * average + interval) / 4;
+	}
+	mTelemetryTimer.start();
 }
 
-void BatteryControllerUpdater::processAcquisitionData(const QList<quint16> &registers)
+void BatteryControllerUpdater::resetSchedule()
 {
-	QString stemp;
+	mSchedule.resize(mCommandCount);
+	for (int i=0; i<mCommandCount; ++i) {
+		CommandSchedule &schedule = mSchedule[i];
+		schedule.interval = baseInterval(mCommands[i]);
+		schedule.due = 0;
+		schedule.values.clear();
+	}
+	mAlarm = false;
+	mZbmState = -1;
+	mTelemetryTimer.invalidate();
+}
 
-	const CompositeCommand &cmd = mCommands[mCommandIndex];
+void BatteryControllerUpdater::speedUp()
+{
+	// Commands already polled at their base interval keep their due time.
+	qint64 now = mStopwatch.elapsed();
+	for (int i=0; i<mSchedule.size(); ++i) {
+		CommandSchedule &schedule = mSchedule[i];
+		int base = baseInterval(mCommands[i]);
+		if (schedule.interval == base)
+			continue;
+		schedule.interval = base;
+		schedule.due = now;
+	}
+}
+
+qint64 BatteryControllerUpdater::nextDueTime() const
+{
+	qint64 due = mStopwatch.elapsed() + MaxReconnectInterval;
+	foreach (const CommandSchedule &schedule, mSchedule)
+		due = qMin(due, schedule.due);
+	return due;
+}
+
+void BatteryControllerUpdater::processAcquisitionData(const CompositeCommand &cmd,
+													   int offset,
+													   const RegisterSpan &registers,
+													   ParameterSample &sample)
+{
 	for (int i=0; i<MaxRegCount; ++i) {
 		const RegisterCommand &ra = cmd.actions[i];
 		if (ra.action == None)
 			break;
-
-			{
-			switch (ra.action) {
-			case BattVolts:
-				QLOG_INFO() << "BattVolts: " << registers[ra.regOffset];
-				mBatteryController->setBattVolts(registers[ra.regOffset]);
-				break;
-			case BussVolts:
-				QLOG_INFO() << "BussVolts: " << registers[ra.regOffset];
-				mBatteryController->setBussVolts(registers[ra.regOffset]);
-				break;
-			case BattAmps:
-				stemp =  QString::number((short) registers[ra.regOffset],10);
-				QLOG_INFO() << "BattAmps: " << stemp;
-				mBatteryController->setBattAmps(stemp.toInt());
-				break;
-			case BussAmps:
-				stemp = QString::number((short) registers[ra.regOffset],10);
-				QLOG_INFO() << "BussAmps: " << registers[ra.regOffset];
-				mBatteryController->setBussAmps(stemp.toInt());
-				break;
-			case BattTemp:
-				QLOG_INFO() << "BattTemp: " << registers[ra.regOffset];
-				mBatteryController->setBattTemp(static_cast<qint16>(registers[ra.regOffset]));
-				break;
-			case AirTemp:
-				QLOG_INFO() << "AirTemp: " << registers[ra.regOffset];
-				mBatteryController->setAirTemp(static_cast<qint16>(registers[ra.regOffset]));
-				break;
-			case SOC:
-				QLOG_INFO() << "SOC: " << registers[ra.regOffset];
-				mBatteryController->setSOC(registers[ra.regOffset]);
-				break;	
-			case StsRegSummary:
-				//QLOG_INFO() << "StsRegSummary: " << registers[ra.regOffset];
-				mBatteryController->setStsRegSummary(registers[ra.regOffset]);
-				break;	
-			case StsRegHardwareFailure:
-				//QLOG_INFO() << "StsRegHardwareFailure: " << registers[ra.regOffset];
-				mBatteryController->setStsRegHardwareFailure(registers[ra.regOffset]);
-				break;
-			case StsRegOperationalFailure:
-				//QLOG_INFO() << "StsRegOperationalFailure: " << registers[ra.regOffset];
-				mBatteryController->setStsRegOperationalFailure(registers[ra.regOffset]);
-				break;	
-			case StsRegWarning:
-				//QLOG_INFO() << "StsRegWarning: " << registers[ra.regOffset];
-				mBatteryController->setStsRegWarning(registers[ra.regOffset]);
-				break;	
-			case StsRegOperationalMode:
-				QLOG_INFO() << "StsRegOperationalMode: " << registers[ra.regOffset];
-				mBatteryController->setStsRegOperationalMode(registers[ra.regOffset]);
-				break;
-			case SOC_AmpHrs:
-				QLOG_INFO() << "SOC_AmpHrs: " << registers[ra.regOffset];
-				mBatteryController->setSOCAmpHrs(static_cast<qint16>(registers[ra.regOffset]));
-				break;			
-			case HealthIndication:
-				//QLOG_INFO() << "HealthIndication: " << registers[ra.regOffset];
-				mBatteryController->setHealthIndication(registers[ra.regOffset]);
-				break;	
-			case ZBMState:
-				QLOG_INFO() << "ZBMState: " << registers[ra.regOffset];
-				mBatteryController->setState(registers[ra.regOffset]);
-				break;
-			case DeviceAddress:
-				QLOG_INFO() << "DeviceAddress: " << registers[ra.regOffset];
-				mBatteryController->setDeviceAddress(registers[ra.regOffset]);
-				break;
-			case ClearStatusRegisterFlags:
-				QLOG_INFO() << "ClearStatusRegisterFlags: " << registers[ra.regOffset];
-				mBatteryController->setClearStatusRegisterFlags(registers[ra.regOffset]);
-				break;
-			case EnableSelfMaintenanceAtTheEndOfDischarge:
-				QLOG_INFO() << "EnableSelfMaintenanceAtTheEndOfDischarge: " << registers[ra.regOffset];
-				mBatteryController->setEnableSelfMaintenanceAtTheEndOfDischarge(registers[ra.regOffset]);
-				break;
-			case EnterRunCommand:
-				QLOG_INFO() << "EnterRunCommand: " << registers[ra.regOffset];
-				mBatteryController->setEnterRunCommand(registers[ra.regOffset]);
-				break;		
-			case SelfDischargeAndMaintenanceCycle:
-				QLOG_INFO() << "SelfDischargeAndMaintenanceCycle: " << registers[ra.regOffset];
-				mBatteryController->setSelfDischargeAndMaintenanceCycle(registers[ra.regOffset]);
-				break;	
-			default:
-				break;
-			}
-		}
+		if (ra.action == NotUsed)
+			continue;
+		// Values of this command start at `offset` within the registers of
+		// the merged request.
+		quint16 value = registers[offset + ra.regOffset];
+		int v = isSigned(ra.action) ? static_cast<qint16>(value) : value;
+		TRACE_SAMPLE(mSlaveAddress, ra.action, v);
+		sample.set(ra.action, v);
 	}
 }
 
 
-void BatteryControllerUpdater::onRequestDelayedSelfMaintenanceChanged()
+void BatteryControllerUpdater::onWriteRequested(int parameter, int value)
 /* This function writes back the changes from the Victron color control to the ZBM registers */
 {
-	QLOG_INFO() <<"ONREQUESTDELAYEDSELFMAINTENANCECHANGED";
-	this->writeRegister(MODBUSREG_ENABLE_SELF_MAINTENANCE_END_OF_DISCHARGE,(quint16) mBatteryController->RequestDelayedSelfMaintenance());
+	switch (parameter) {
+	case ClearStatusRegisterFlags:
+		QLOG_INFO() << "ONCLEARSTATUSREGISTERFLAGSCHANGED";
+		writeRegister(MODBUSREG_CLEAR_STATUS_REGISTER_FLAGS, static_cast<quint16>(value));
+		break;
+	case EnableSelfMaintenanceAtTheEndOfDischarge:
+		QLOG_INFO() << "ONREQUESTDELAYEDSELFMAINTENANCECHANGED";
+		writeRegister(MODBUSREG_ENABLE_SELF_MAINTENANCE_END_OF_DISCHARGE, static_cast<quint16>(value));
+		break;
+	case SelfDischargeAndMaintenanceCycle:
+		QLOG_INFO() << "ONREQUESTIMMEDIATESELFMAINTENANCECHANGED";
+		writeRegister(MODBUSREG_SELF_DISCHARGE_AND_MAINTENANCE_CYCLE, static_cast<quint16>(value));
+		break;
+	default:
+		break;
+	}
 }
 
+void BatteryControllerUpdater::setParameters(const ParameterSample &sample)
+{
+	// The controller lives in the main thread, where it is used by the D-Bus
+	// bridge. So values are passed through the event loop of that thread.
+	QMetaObject::invokeMethod(mBatteryController, "setParameters",
+							  Q_ARG(ParameterSample, sample));
+}
 
-void BatteryControllerUpdater::onRequestImmediateSelfMaintenanceChanged()
-/* This function writes back the changes from the Victron color control to the ZBM registers */
+void BatteryControllerUpdater::setSerial(const QString &serial)
 {
-	QLOG_INFO() << "ONREQUESTIMMEDIATESELFMAINTENANCECHANGED";
-	this->writeRegister(MODBUSREG_SELF_DISCHARGE_AND_MAINTENANCE_CYCLE,(quint16) mBatteryController->RequestImmediateSelfMaintenance());
+	mSerial = serial;
+	QMetaObject::invokeMethod(mBatteryController, "setSerial",
+							  Q_ARG(QString, serial));
 }
 
-void BatteryControllerUpdater::onClearStatusRegisterFlagsChanged()
-/* This function writes back the changes from the Victron color control to the ZBM registers */
+void BatteryControllerUpdater::setConnectionState(ConnectionState state)
 {
-	QLOG_INFO() << "ONCLEARSTATUSREGISTERFLAGSCHANGED";
-	this->writeRegister(MODBUSREG_CLEAR_STATUS_REGISTER_FLAGS,(quint16) mBatteryController->ClearStatusRegisterFlags());
+	QMetaObject::invokeMethod(mBatteryController, "setConnectionState",
+							  Q_ARG(ConnectionState, state));
 }
@@ -3,11 +3,11 @@
 
 #include <QElapsedTimer>
 #include <QObject>
+#include <QVector>
+#include "batteryController.h"
 #include "defines.h"
 #include "modbus_rtu.h"
 
-class BatteryController;
-class BatteryControllerSettings;
 struct CompositeCommand;
 
 /*!
@@ -16,6 +16,15 @@ struct CompositeCommand;
  * retrieve data from the device. The value will be stored in an `AcSensor`
  * object.
  *
+ * The updater lives in the thread of its Modbus connection, while the
+ * `BatteryController` lives in the main thread. All values are passed to the
+ * controller using queued calls, so the updater never has to wait for the
+ * main thread.
+ *
+ * Each group of registers has its own poll interval. Groups whose values do
+ * not change are read less often, until an alarm is reported or the state
+ * of the battery changes.
+ *
  * This class is implemented as a state engine. The diagram below shows the
  * progress through the states.
  * @dotfile battery_controller_updater_states.dot
@@ -40,19 +49,17 @@ public:
 	 */
 	BatteryControllerUpdater(BatteryController *mBatteryController, ModbusRtu *modbus, QObject *parent = 0);
 
-	/*!
-	 * Returns the settings object.
-	 * This object is created by the `AcSensorUpdater` when a device has been
-	 * detected. It will be null while the `connectionState` of the `AcSensor`
-	 * is `Disconnected` or `Searched`.
-	 * The information in the settings will be used for data retrieval and can
-	 * be changed while retrieval is active. This may lead to reinitialization
-	 * of the updater (and the energy meter itself).
-	 */
-	BatteryControllerSettings *settings();
-	void readRegisters(quint16 startReg, quint16 count);
+	void readRegisters(quint16 startReg, quint16 count,
+					   ModbusRtu::Priority priority = ModbusRtu::StatusPriority);
 
 	void writeRegister(quint16 reg, quint16 value);
+
+	/*!
+	 * Sets the target intervals (ms) between 2 reads of the registers with
+	 * telemetry (voltage, current, etc.) and of the status registers.
+	 * Registers whose values do not change may be read less often.
+	 */
+	void setPollIntervals(int telemetry, int status);
 	
 signals:
 	void infoChanged(BatteryController *);
@@ -60,16 +67,15 @@ signals:
 private slots:
 	void onErrorReceived(int errorType, quint8 addr, int exception);
 
-	void onReadCompleted(int function, quint8 addr, const QList<quint16> &registers);
+	void onReadCompleted(int function, quint8 addr, const RegisterSpan &registers);
 
 	void onWriteCompleted(int function, quint8 addr, quint16 address, quint16 value);
 
 	void onWaitFinished();
 
 	void onUpdateSettings();
-	void onRequestDelayedSelfMaintenanceChanged();
-	void onRequestImmediateSelfMaintenanceChanged();
-	void onClearStatusRegisterFlagsChanged();
+
+	void onWriteRequested(int parameter, int value);
 
 
 private:
@@ -77,12 +83,81 @@ private:
 
 	void startNextAcquisition();
 
-	void processAcquisitionData(const QList<quint16> &registers);
+	/*!
+	 * A single read request, which retrieves the registers of one or more
+	 * adjacent `CompositeCommand`s.
+	 */
+	struct ReadBlock {
+		quint16 reg;
+		quint16 count;
+		int firstCommand;
+		int lastCommand;
+		ModbusRtu::Priority priority;
+	};
 
-	double getDouble(const QList<quint16> &registers, int offset, int size,
+	/*!
+	 * Poll schedule of a single `CompositeCommand`.
+	 */
+	struct CommandSchedule {
+		// Current interval (ms), between the base interval and `maxBackOff`
+		// times the base interval.
+		int interval;
+		// Time (on `mStopwatch`) of the next read
+		qint64 due;
+		// Registers retrieved by the previous read
+		QVector<quint16> values;
+	};
+
+	void planAcquisition();
+
+	/*!
+	 * Sets the time of the next read of command `index`, after its registers
+	 * have been read (starting at `offset` within `registers`).
+	 */
+	void updateSchedule(int index, int offset, const RegisterSpan &registers);
+
+	/*!
+	 * Restores the base interval of all commands, and makes them due now.
+	 */
+	void resetSchedule();
+
+	/*!
+	 * Restores the base interval of the commands that have backed off, and
+	 * makes them due now.
+	 */
+	void speedUp();
+
+	/// Returns the time (on `mStopwatch`) at which the next command is due.
+	qint64 nextDueTime() const;
+
+	/// Returns the interval of `cmd` when its values are changing.
+	int baseInterval(const CompositeCommand &cmd) const;
+
+	/*!
+	 * Updates the achieved telemetry interval in the `ModbusCounters` of the
+	 * connection. Called at the start of each acquisition cycle.
+	 */
+	void updatePollStatistics();
+
+	void processAcquisitionData(const ReadBlock &block,
+								const RegisterSpan &registers);
+
+	void processAcquisitionData(const CompositeCommand &cmd, int offset,
+								const RegisterSpan &registers,
+								ParameterSample &sample);
+
+	double getDouble(const RegisterSpan &registers, int offset, int size,
 					 double factor);
 
+	void setParameters(const ParameterSample &sample);
+
+	void setSerial(const QString &serial);
+
+	void setConnectionState(ConnectionState state);
+
 	enum State {
+		// Reads the device ID, serial and firmware version at once
+		Identify,
 		DeviceId,
 		VersionCode,
 		Serial,
@@ -114,20 +189,51 @@ private:
 		RegEm112Serial = 0x5000,
 	};
 
+	enum {
+		// Number of registers read in the `Identify` state
+		IdentifyCount = RegDevice - RegFirmwareVersion + 1
+	};
+
+	/*!
+	 * Returns the first state of the identification of the device: `Identify`
+	 * unless the device does not support reading all registers at once.
+	 */
+	State identifyState() const;
+
+	static QString toSerial(quint16 high, quint16 low);
+
 	BatteryController *mBatteryController;
-	BatteryControllerSettings *mSettings;
 	ModbusRtu *mModbus;
+	int mSlaveAddress;
+	QString mSerial;
 	QTimer *mAcquisitionTimer;
 	QTimer *mSettingsUpdateTimer;
 	int mTimeoutCount;
 	bool mSetupRequested;
 	int mApplication;
+	// Time since the creation of the updater
 	QElapsedTimer mStopwatch;
+	// Time since the first request of the current acquisition cycle
+	QElapsedTimer mSweepTimer;
 	State mState;
 	const CompositeCommand *mCommands;
 	int mCommandCount;
-	int mCommandIndex;
-	int mAcquisitionIndex;
+	QVector<ReadBlock> mReadBlocks;
+	int mBlockIndex;
+	// Same size and order as `mCommands`
+	QVector<CommandSchedule> mSchedule;
+	// Started at the beginning of each acquisition cycle with telemetry
+	QElapsedTimer mTelemetryTimer;
+	int mMaxReadGap;
+	int mTelemetryInterval;
+	int mStatusInterval;
+	// True if StsRegSummary reported an alarm
+	bool mAlarm;
+	// Last known state of the battery, -1 if unknown
+	int mZbmState;
+	// False if the device rejected the read of all identification registers
+	bool mCombinedIdentify;
+	int mReconnectInterval;
 };
 
 #endif // BATTERY_CONTROLLER_UPDATER_H
@@ -0,0 +1,111 @@
+#include <QUrl>
+#include "batteryController.h"
+#include "battery_controller_scanner.h"
+#include "battery_controller_updater.h"
+#include "bus_worker.h"
+#include "modbus_rtu.h"
+#include "recording_transport.h"
+#include "replay_transport.h"
+#include "serial_transport.h"
+#include "tcp_transport.h"
+
+static const quint16 ModbusTcpPort = 502;
+
+static ModbusTransport *createTransport(const QString &portName)
+{
+	// Slaves behind an Ethernet gateway are addressed with an URL:
+	// tcp://host[:port] for Modbus TCP, or rtu+tcp://host[:port] for
+	// RTU frames tunneled through a TCP connection.
+	// replay:file plays back a recording made with `RecordingTransport`
+	// (replay:file?fast to play it back as fast as possible).
+	QUrl url(portName);
+	if (url.scheme() == "tcp") {
+		return new TcpTransport(url.host(), url.port(ModbusTcpPort),
+								ModbusTransport::MbapFraming);
+	}
+	if (url.scheme() == "rtu+tcp") {
+		return new TcpTransport(url.host(), url.port(ModbusTcpPort),
+								ModbusTransport::RtuFraming);
+	}
+	if (url.scheme() == "replay") {
+		return new ReplayTransport(url.path(), url.hasQueryItem("fast") ?
+								   ReplayTransport::AsFastAsPossible :
+								   ReplayTransport::RealTime);
+	}
+	return new SerialTransport(portName, 19200);
+}
+
+BusWorker::BusWorker(const QString &portName, int firstAddress,
+					 int lastAddress, ModbusCounters *counters,
+					 QObject *parent):
+	QObject(parent),
+	mPortName(portName),
+	mFirstAddress(firstAddress),
+	mLastAddress(lastAddress),
+	mCounters(counters),
+	mTelemetryInterval(0),
+	mStatusInterval(0),
+	mModbus(0),
+	mScanner(0)
+{
+}
+
+QString BusWorker::portName() const
+{
+	return mPortName;
+}
+
+void BusWorker::setRecordFileName(const QString &fileName)
+{
+	mRecordFileName = fileName;
+}
+
+void BusWorker::start()
+{
+	Q_ASSERT(mModbus == 0);
+	ModbusTransport *transport = createTransport(mPortName);
+	if (!mRecordFileName.isEmpty())
+		transport = new RecordingTransport(transport, mRecordFileName);
+	mModbus = new ModbusRtu(transport, this);
+	mModbus->setCounters(mCounters);
+	// The transport may report errors from the reader thread of the serial
+	// port. The description is converted to a string right away, so it can
+	// be passed to the main thread.
+	connect(mModbus, SIGNAL(serialEvent(const char *)),
+			this, SLOT(onSerialEvent(const char *)), Qt::DirectConnection);
+	mScanner = new BatteryControllerScanner(mModbus, mFirstAddress,
+											mLastAddress, this);
+	connect(mScanner, SIGNAL(deviceFound(int)), this, SIGNAL(deviceFound(int)));
+	mScanner->setPreferredAddresses(mPreferredAddresses);
+	mScanner->start();
+}
+
+void BusWorker::addDevice(BatteryController *controller)
+{
+	Q_ASSERT(mModbus != 0);
+	BatteryControllerUpdater *updater =
+			new BatteryControllerUpdater(controller, mModbus, this);
+	if (mTelemetryInterval > 0)
+		updater->setPollIntervals(mTelemetryInterval, mStatusInterval);
+}
+
+void BusWorker::setPreferredAddresses(const QList<int> &addresses)
+{
+	mPreferredAddresses = addresses;
+	if (mScanner != 0)
+		mScanner->setPreferredAddresses(addresses);
+}
+
+void BusWorker::setPollIntervals(int telemetry, int status)
+{
+	mTelemetryInterval = telemetry;
+	mStatusInterval = status;
+	foreach (BatteryControllerUpdater *updater,
+			 findChildren<BatteryControllerUpdater *>())
+		updater->setPollIntervals(telemetry, status);
+}
+
+void BusWorker::onSerialEvent(const char *description)
+{
+	emit serialEvent(QString::fromLocal8Bit(description));
+}
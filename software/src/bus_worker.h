@@ -0,0 +1,87 @@
+#ifndef BUS_WORKER_H
+#define BUS_WORKER_H
+
+#include <QList>
+#include <QObject>
+#include <QString>
+
+class BatteryController;
+class BatteryControllerScanner;
+class ModbusRtu;
+struct ModbusCounters;
+
+/*!
+ * Handles all communication on a single Modbus connection.
+ * The worker owns the `ModbusRtu` object, the `BatteryControllerScanner`,
+ * and the `BatteryControllerUpdater`s of the batteries on the connection.
+ * It is supposed to be moved to its own thread, so the timing on the bus does
+ * not depend on the load of the main thread (which handles the D-Bus).
+ * All objects owned by the worker are created in `start` and `addDevice`,
+ * which should be invoked using queued calls.
+ */
+class BusWorker : public QObject
+{
+	Q_OBJECT
+public:
+	/*!
+	 * `counters` (which may be 0) will be updated by the Modbus connection.
+	 * It is not owned by the worker, and should outlive it.
+	 */
+	BusWorker(const QString &portName, int firstAddress, int lastAddress,
+			  ModbusCounters *counters = 0, QObject *parent = 0);
+
+	QString portName() const;
+
+	/*!
+	 * Records all traffic on the connection to `fileName` (see
+	 * `RecordingTransport`). Must be called before `start`.
+	 */
+	void setRecordFileName(const QString &fileName);
+
+public slots:
+	/*!
+	 * Opens the connection and starts searching for batteries.
+	 */
+	void start();
+
+	/*!
+	 * Starts retrieving data from the battery associated with `controller`.
+	 * The controller should live in the main thread. It should not be
+	 * destroyed before the worker.
+	 */
+	void addDevice(BatteryController *controller);
+
+	/*!
+	 * Sets the target poll intervals (ms) of all batteries on the
+	 * connection (see `BatteryControllerUpdater::setPollIntervals`).
+	 */
+	void setPollIntervals(int telemetry, int status);
+
+	/*!
+	 * Sets the addresses where batteries have been found before. These are
+	 * probed before all other addresses.
+	 */
+	void setPreferredAddresses(const QList<int> &addresses);
+
+signals:
+	void deviceFound(int slaveAddress);
+
+	void serialEvent(const QString &description);
+
+private slots:
+	void onSerialEvent(const char *description);
+
+private:
+	QString mPortName;
+	int mFirstAddress;
+	int mLastAddress;
+	ModbusCounters *mCounters;
+	QString mRecordFileName;
+	int mTelemetryInterval;
+	int mStatusInterval;
+	QList<int> mPreferredAddresses;
+	ModbusRtu *mModbus;
+	BatteryControllerScanner *mScanner;
+};
+
+#endif // BUS_WORKER_H
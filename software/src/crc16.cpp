@@ -46,6 +46,25 @@ static uint8_t CrcLo[] =
 	0x40
 };
 
+struct SliceTables
+{
+	SliceTables()
+	{
+		for (int i=0; i<256; ++i)
+			table[0][i] = (CrcLo[i] << 8) | CrcHi[i];
+		for (int k=1; k<4; ++k) {
+			for (int i=0; i<256; ++i) {
+				uint16_t v = table[k - 1][i];
+				table[k][i] = (v >> 8) ^ table[0][v & 0xFF];
+			}
+		}
+	}
+
+	uint16_t table[4][256];
+};
+
+static const SliceTables Slices;
+
 Crc16::Crc16()
 {
 	reset();
@@ -65,8 +84,33 @@ void Crc16::add(uint8_t byte)
 
 void Crc16::add(const QByteArray &bytes)
 {
-	foreach (uint8_t b, bytes)
-		add(b);
+	add(reinterpret_cast<const uint8_t *>(bytes.constData()), bytes.size());
+}
+
+void Crc16::add(const uint8_t *bytes, int length)
+{
+	// Note that the register value here is the 'reflected' CRC as defined
+	// by the standard, while mCrcLo/mCrcHi store the bytes in transmission
+	// order.
+	uint32_t crc = mCrcHi | (mCrcLo << 8);
+	// Slicing-by-4: process 4 bytes per iteration using 4 lookup tables.
+	// This is faster than the byte wise lookup even for 8 byte frames (see
+	// tools/crc-benchmark).
+	const uint8_t *end = bytes + (length & ~3);
+	for (; bytes < end; bytes += 4) {
+		uint32_t x = crc ^ (bytes[0] | (bytes[1] << 8) |
+							(static_cast<uint32_t>(bytes[2]) << 16) |
+							(static_cast<uint32_t>(bytes[3]) << 24));
+		crc = Slices.table[3][x & 0xFF] ^
+			  Slices.table[2][(x >> 8) & 0xFF] ^
+			  Slices.table[1][(x >> 16) & 0xFF] ^
+			  Slices.table[0][x >> 24];
+	}
+	// The remaining bytes: one lookup in the 16 bit table per byte.
+	for (int i=0; i<(length & 3); ++i)
+		crc = (crc >> 8) ^ Slices.table[0][(crc ^ bytes[i]) & 0xFF];
+	mCrcHi = crc & 0xFF;
+	mCrcLo = crc >> 8;
 }
 
 void Crc16::reset()
@@ -81,3 +125,10 @@ uint16_t Crc16::getValue(const QByteArray &bytes)
 	crc.add(bytes);
 	return crc.getValue();
 }
+
+uint16_t Crc16::getValue(const uint8_t *bytes, int length)
+{
+	Crc16 crc;
+	crc.add(bytes, length);
+	return crc.getValue();
+}
@@ -23,6 +23,11 @@ public:
 
 	void add(const QByteArray &bytes);
 
+	/*!
+	 * Adds a block of bytes. The bytes are processed 4 at a time.
+	 */
+	void add(const uint8_t *bytes, int length);
+
 	void reset();
 
 	/*!
@@ -32,6 +37,8 @@ public:
 	 */
 	static uint16_t getValue(const QByteArray &bytes);
 
+	static uint16_t getValue(const uint8_t *bytes, int length);
+
 private:
 	uint8_t mCrcLo;
 	uint8_t mCrcHi;
@@ -1,4 +1,8 @@
+#include <QDBusArgument>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
 #include <QDBusVariant>
+#include <QSet>
 #include <QsLog.h>
 #include <QTimer>
 #include <velib/qt/v_busitem.h>
@@ -8,6 +12,10 @@
 
 Q_DECLARE_METATYPE(QList<int>)
 
+// All bridges live in the main thread, so the counters need no locking.
+static int PropertiesChangedCount = 0;
+static int ItemsChangedCount = 0;
+
 DBusBridge::DBusBridge(QObject *parent) :
 	QObject(parent),
 	mServiceRegistered(false),
@@ -60,14 +68,38 @@ void DBusBridge::produce(QObject *src, const char *property,
 	VBusItem *vbi = new VBusItem(this);
 	QVariant value = src->property(property);
 	toDBus(path, value);
+	connectItem(vbi, src, property, path);
+	// The initial value counts as published, so the deadband and the maximum
+	// staleness also apply to values that never change after startup.
+	BusItemBridge &bib = mBusItems.last();
+	bib.publishedValue = value;
+	bib.publishTimer.start();
 	if (!value.isValid())
 		value = QVariant::fromValue(QList<int>());
-	connectItem(vbi, src, property, path);
 	QDBusConnection connection = VBusItems::getConnection(mServiceName);
 	vbi->produce(connection, path, "?", value, unit, precision);
 	addVBusNodes(path, vbi);
 }
 
+void DBusBridge::produce(QObject *src, const char *property,
+						 const QString &path, const PublishPolicy &policy,
+						 const QString &unit, int precision)
+{
+	produce(src, property, path, unit, precision);
+	setPublishPolicy(path, policy);
+}
+
+void DBusBridge::setPublishPolicy(const QString &path,
+								  const PublishPolicy &policy)
+{
+	for (QList<BusItemBridge>::iterator it = mBusItems.begin();
+		 it != mBusItems.end();
+		 ++it) {
+		if (it->path == path)
+			it->policy = policy;
+	}
+}
+
 void DBusBridge::produce(const QString &path, const QVariant &value,
 						 const QString &unit, int precision)
 {
@@ -92,16 +124,24 @@ void DBusBridge::consume(const QString &service, QObject *src,
 						 const char *property, const QVariant &defaultValue,
 						 const QString &path)
 {
-	addSetting(path, defaultValue, QVariant(0), QVariant(0));
-	consume(service, src, property, path);
+	addSetting(service, src, property, path, defaultValue, QVariant(0),
+			   QVariant(0));
 }
 
 void DBusBridge::consume(const QString &service, QObject *src,
 						 const char *property, double defaultValue,
 						 double minValue, double maxValue, const QString &path)
 {
-	addSetting(path, QVariant(defaultValue), QVariant(minValue), QVariant(maxValue));
-	consume(service, src, property, path);
+	addSetting(service, src, property, path, QVariant(defaultValue),
+			   QVariant(minValue), QVariant(maxValue));
+}
+
+void DBusBridge::consume(const QString &service, QObject *src,
+						 const char *property, int defaultValue,
+						 int minValue, int maxValue, const QString &path)
+{
+	addSetting(service, src, property, path, QVariant(defaultValue),
+			   QVariant(minValue), QVariant(maxValue));
 }
 
 QString DBusBridge::serviceName() const
@@ -143,14 +183,28 @@ bool DBusBridge::addSetting(const QString &path,
 							const QVariant &minValue,
 							const QVariant &maxValue)
 {
-	if (!path.startsWith("/Settings"))
+	QDBusMessage m = createAddSettingCall(path, defaultValue, minValue,
+										  maxValue);
+	if (m.type() != QDBusMessage::MethodCallMessage)
 		return false;
+	QDBusConnection &connection = VBusItems::getConnection();
+	QDBusMessage reply = connection.call(m);
+	return reply.type() == QDBusMessage::ReplyMessage;
+}
+
+QDBusMessage DBusBridge::createAddSettingCall(const QString &path,
+											  const QVariant &defaultValue,
+											  const QVariant &minValue,
+											  const QVariant &maxValue)
+{
+	if (!path.startsWith("/Settings/"))
+		return QDBusMessage();
 	int groupStart = path.indexOf('/', 1);
 	if (groupStart == -1)
-		return false;
+		return QDBusMessage();
 	int nameStart = path.lastIndexOf('/');
 	if (nameStart <= groupStart)
-		return false;
+		return QDBusMessage();
 	QChar type;
 	switch (defaultValue.type()) {
 	case QVariant::Int:
@@ -163,12 +217,11 @@ bool DBusBridge::addSetting(const QString &path,
 		type = 's';
 		break;
 	default:
-		return false;
+		return QDBusMessage();
 	}
 	QString group = path.mid(groupStart + 1, nameStart - groupStart - 1);
 	QString name = path.mid(nameStart + 1);
-	QDBusConnection &connection = VBusItems::getConnection();
-	QDBusMessage m = QDBusMessage::createMethodCall(
+	return QDBusMessage::createMethodCall(
 						 "com.victronenergy.settings",
 						 "/Settings",
 						 "com.victronenergy.Settings",
@@ -179,32 +232,172 @@ bool DBusBridge::addSetting(const QString &path,
 					 << QString(type)
 					 << QVariant::fromValue(QDBusVariant(minValue))
 					 << QVariant::fromValue(QDBusVariant(maxValue));
-	QDBusMessage reply = connection.call(m);
-	return reply.type() == QDBusMessage::ReplyMessage;
 }
 
-void DBusBridge::onPropertyChanged()
+void DBusBridge::addSetting(const QString &service, QObject *src,
+							const char *property, const QString &path,
+							const QVariant &defaultValue,
+							const QVariant &minValue, const QVariant &maxValue)
 {
-	QObject *src = sender();
-	int signalIndex = senderSignalIndex();
-	const QMetaObject *mo = src->metaObject();
-	for (int i=0; i<mo->propertyCount(); ++i) {
-		QMetaProperty mp = mo->property(i);
-		if (mp.hasNotifySignal() && mp.notifySignalIndex() == signalIndex) {
-			for (QList<BusItemBridge>::iterator it = mBusItems.begin();
-				 it != mBusItems.end();
-				 ++it) {
-				if (it->src == src &&
-					it->property.isValid() &&
-					strcmp(it->property.name(), mp.name()) == 0) {
-					if (mUpdateTimer == 0)
-						publishValue(*it);
-					else
-						it->changed	= true;
-					break;
-				}
-			}
+	PendingSetting ps;
+	ps.service = service;
+	ps.src = src;
+	ps.property = property;
+	ps.path = path;
+	ps.defaultValue = defaultValue;
+	ps.minValue = minValue;
+	ps.maxValue = maxValue;
+	if (mQueuedSettings.isEmpty())
+		QTimer::singleShot(0, this, SLOT(onSendSettings()));
+	mQueuedSettings.append(ps);
+}
+
+void DBusBridge::onSendSettings()
+{
+	if (mQueuedSettings.isEmpty())
+		return;
+	QList<PendingSetting> settings = mQueuedSettings;
+	mQueuedSettings.clear();
+	// AddSettings takes an array of dictionaries, one per setting. The paths
+	// are relative to the /Settings object. min and max are omitted when
+	// the setting has no limits, like the zero limits passed to AddSetting.
+	QList<PendingSetting> validSettings;
+	QDBusArgument arg;
+	arg.beginArray(qMetaTypeId<QVariantMap>());
+	foreach (const PendingSetting &ps, settings) {
+		// Apply the same checks as AddSetting, so settings are rejected
+		// whichever method the settings service supports.
+		QDBusMessage check = createAddSettingCall(ps.path, ps.defaultValue,
+												  ps.minValue, ps.maxValue);
+		if (check.type() != QDBusMessage::MethodCallMessage) {
+			QLOG_ERROR() << "Invalid setting:" << ps.path;
+			consume(ps.service, ps.src, ps.property.constData(), ps.path);
+			continue;
+		}
+		validSettings.append(ps);
+		QVariantMap setting;
+		setting.insert("path", ps.path.mid(QString("/Settings/").size()));
+		setting.insert("default", ps.defaultValue);
+		if (ps.minValue != ps.maxValue) {
+			setting.insert("min", ps.minValue);
+			setting.insert("max", ps.maxValue);
 		}
+		arg << setting;
+	}
+	arg.endArray();
+	if (validSettings.isEmpty())
+		return;
+	QDBusMessage m = QDBusMessage::createMethodCall(
+						 "com.victronenergy.settings",
+						 "/Settings",
+						 "com.victronenergy.Settings",
+						 "AddSettings")
+					 << QVariant::fromValue(arg);
+	QDBusConnection &connection = VBusItems::getConnection();
+	watchSettingsCall(connection.asyncCall(m), true, validSettings);
+}
+
+void DBusBridge::sendSettingsOneByOne(const QList<PendingSetting> &settings)
+{
+	QDBusConnection &connection = VBusItems::getConnection();
+	foreach (const PendingSetting &ps, settings) {
+		QDBusMessage m = createAddSettingCall(ps.path, ps.defaultValue,
+											  ps.minValue, ps.maxValue);
+		QList<PendingSetting> single;
+		single.append(ps);
+		if (m.type() == QDBusMessage::MethodCallMessage) {
+			watchSettingsCall(connection.asyncCall(m), false, single);
+		} else {
+			// Invalid setting. Consume it anyway, like the blocking version
+			// of addSetting did.
+			QLOG_ERROR() << "Invalid setting:" << ps.path;
+			consume(ps.service, ps.src, ps.property.constData(), ps.path);
+		}
+	}
+}
+
+void DBusBridge::watchSettingsCall(const QDBusPendingCall &call, bool batch,
+								   const QList<PendingSetting> &settings)
+{
+	QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
+	SettingsCall sc;
+	sc.batch = batch;
+	sc.settings = settings;
+	mSettingCalls.insert(watcher, sc);
+	connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher *)),
+			this, SLOT(onSettingsAdded(QDBusPendingCallWatcher *)));
+}
+
+void DBusBridge::onSettingsAdded(QDBusPendingCallWatcher *watcher)
+{
+	watcher->deleteLater();
+	SettingsCall sc = mSettingCalls.take(watcher);
+	const QList<PendingSetting> &settings = sc.settings;
+	if (watcher->isError()) {
+		QDBusError error = watcher->error();
+		// Older versions of the settings service do not support AddSettings.
+		if (sc.batch && error.type() == QDBusError::UnknownMethod) {
+			sendSettingsOneByOne(settings);
+			return;
+		}
+		foreach (const PendingSetting &ps, settings)
+			QLOG_WARN() << "Could not add setting" << ps.path << ':'
+						<< error.message();
+	}
+	// AddSettings returns a dictionary for each setting, with the path
+	// (relative to /Settings) and a non-zero error if the setting could not
+	// be added.
+	QSet<QString> failedPaths;
+	if (sc.batch && !watcher->isError()) {
+		QDBusArgument results =
+				watcher->reply().arguments().value(0).value<QDBusArgument>();
+		results.beginArray();
+		while (!results.atEnd()) {
+			QVariantMap result;
+			results >> result;
+			if (result.value("error").toInt() != 0)
+				failedPaths.insert(result.value("path").toString());
+		}
+		results.endArray();
+	}
+	foreach (const PendingSetting &ps, settings) {
+		if (failedPaths.contains(ps.path.mid(QString("/Settings/").size()))) {
+			QLOG_WARN() << "Could not add setting" << ps.path;
+			continue;
+		}
+		consume(ps.service, ps.src, ps.property.constData(), ps.path);
+	}
+}
+
+void DBusBridge::onPropertyChanged()
+{
+	SignalKey key(sender(), senderSignalIndex());
+	QHash<SignalKey, QList<int> >::const_iterator it = mSignalItems.find(key);
+	if (it == mSignalItems.end())
+		return;
+	VBusItemChanges changes;
+	foreach (int i, it.value()) {
+		BusItemBridge &bib = mBusItems[i];
+		if (mUpdateTimer == 0)
+			publishValue(bib, changes);
+		else
+			bib.changed = true;
+	}
+	notifyItemsChanged(changes);
+}
+
+void DBusBridge::setChanged(const QString &path)
+{
+	QHash<QString, int>::const_iterator it = mPathItems.find(path);
+	if (it == mPathItems.end())
+		return;
+	BusItemBridge &bib = mBusItems[it.value()];
+	if (mUpdateTimer == 0) {
+		VBusItemChanges changes;
+		publishValue(bib, changes);
+		notifyItemsChanged(changes);
+	} else {
+		bib.changed = true;
 	}
 }
 
@@ -236,6 +429,10 @@ void DBusBridge::onVBusItemChanged()
 			break;
 		}
 	}
+	// Items of settings which are still being created have not been added
+	// to mBusItems yet.
+	if (checkInit && (!mQueuedSettings.isEmpty() || !mSettingCalls.isEmpty()))
+		checkInit = false;
 	if (checkInit) {
 		foreach (BusItemBridge bib, mBusItems) {
 			if (!bib.initialized) {
@@ -250,14 +447,24 @@ void DBusBridge::onVBusItemChanged()
 
 void DBusBridge::onUpdateTimer()
 {
+	VBusItemChanges changes;
 	for (QList<BusItemBridge>::iterator it = mBusItems.begin();
 		 it != mBusItems.end();
 		 ++it) {
-		if (it->changed) {
-			publishValue(*it);
-			it->changed = false;
-		}
+		const PublishPolicy &policy = it->policy;
+		bool published = it->publishTimer.isValid();
+		qint64 elapsed = published ? it->publishTimer.elapsed() : 0;
+		bool stale = published && policy.maxStaleness > 0 &&
+				elapsed >= policy.maxStaleness;
+		if (!it->changed && !stale)
+			continue;
+		// Changes arriving too soon are kept until the interval has passed.
+		if (!stale && published && elapsed < policy.minInterval)
+			continue;
+		publishValue(*it, changes, stale);
+		it->changed = false;
 	}
+	notifyItemsChanged(changes);
 }
 
 void DBusBridge::connectItem(VBusItem *busItem, QObject *src,
@@ -289,12 +496,20 @@ void DBusBridge::connectItem(VBusItem *busItem, QObject *src,
 			} else {
 				QMetaProperty mp = mo->property(i);
 				if (mp.hasNotifySignal()) {
-					QMetaMethod signal = mp.notifySignal();
-					int index = metaObject()->indexOfSlot("onPropertyChanged()");
-					QMetaMethod slot = metaObject()->method(index);
-					connect(src, signal, this, slot);
+					SignalKey key(src, mp.notifySignalIndex());
+					QList<int> &items = mSignalItems[key];
+					if (items.isEmpty()) {
+						// Connect only once, even if the signal is shared
+						// by several properties.
+						QMetaMethod signal = mp.notifySignal();
+						int index = metaObject()->indexOfSlot("onPropertyChanged()");
+						QMetaMethod slot = metaObject()->method(index);
+						connect(src, signal, this, slot);
+					}
+					items.append(mBusItems.size());
 				}
 				bib.property = mp;
+				mPathItems.insert(path, mBusItems.size());
 			}
 		}
 	}
@@ -311,15 +526,62 @@ void DBusBridge::addVBusNodes(const QString &path, VBusItem *vbi)
 	mServiceRoot->addChild(path, vbi);
 }
 
-void DBusBridge::publishValue(DBusBridge::BusItemBridge &item)
+bool DBusBridge::publishValue(DBusBridge::BusItemBridge &item,
+							  VBusItemChanges &changes, bool force)
 {
 	QVariant value = item.src->property(item.property.name());
 	if (!toDBus(item.path, value))
-		return;
+		return false;
+	if (!force && item.publishTimer.isValid() &&
+		withinDeadband(item.policy, item.publishedValue, value))
+		return false;
+	item.publishedValue = value;
+	item.publishTimer.start();
 	if (!value.isValid())
 		value = QVariant::fromValue(QList<int>());
 	mUpdateBusy = true;
 
 	item.item->setValue(value);
 	mUpdateBusy = false;
+	++PropertiesChangedCount;
+	QVariantMap &entry = changes[item.path];
+	entry.insert("Value", value);
+	entry.insert("Text", item.item->getText());
+	return true;
+}
+
+bool DBusBridge::withinDeadband(const PublishPolicy &policy,
+								const QVariant &published,
+								const QVariant &value)
+{
+	if (policy.absoluteDeadband <= 0 && policy.relativeDeadband <= 0)
+		return false;
+	// Changes from or to an invalid value are always published.
+	bool ok1 = false;
+	bool ok2 = false;
+	double v1 = published.toDouble(&ok1);
+	double v2 = value.toDouble(&ok2);
+	if (!ok1 || !ok2 || !published.isValid() || !value.isValid())
+		return false;
+	double delta = qAbs(v2 - v1);
+	return delta < policy.absoluteDeadband ||
+			delta < policy.relativeDeadband * qAbs(v1);
+}
+
+void DBusBridge::notifyItemsChanged(const VBusItemChanges &changes)
+{
+	if (changes.isEmpty() || mServiceRoot.isNull())
+		return;
+	mServiceRoot->notifyItemsChanged(changes);
+	++ItemsChangedCount;
+}
+
+int DBusBridge::propertiesChangedCount()
+{
+	return PropertiesChangedCount;
+}
+
+int DBusBridge::itemsChangedCount()
+{
+	return ItemsChangedCount;
 }
@@ -1,17 +1,50 @@
 #ifndef DBUS_BRIDGE_H
 #define DBUS_BRIDGE_H
 
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QList>
 #include <QMetaProperty>
 #include <QObject>
+#include <QPair>
 #include <QPointer>
 #include <QString>
+#include "v_bus_node.h"
 
 class QDBusConnection;
+class QDBusMessage;
+class QDBusPendingCall;
+class QDBusPendingCallWatcher;
 class QDBusVariant;
 class QTimer;
 class VBusItem;
-class VBusNode;
+
+/*!
+ * Limits the number of updates sent for a single D-Bus path.
+ * The default policy publishes every change.
+ */
+struct PublishPolicy
+{
+	PublishPolicy():
+		absoluteDeadband(0),
+		relativeDeadband(0),
+		minInterval(0),
+		maxStaleness(0)
+	{
+	}
+
+	/// Smaller changes (in the unit of the value) are not published.
+	double absoluteDeadband;
+	/// Changes smaller than this fraction of the published value are not
+	/// published.
+	double relativeDeadband;
+	/// Minimum time between 2 updates in milliseconds.
+	int minInterval;
+	/// Time (in milliseconds) after which the value will be published again,
+	/// even if it did not change. Zero disables this.
+	int maxStaleness;
+};
 
 /*!
  * \brief Synchronizes QT properties with DBus objects.
@@ -23,6 +56,8 @@ class VBusNode;
  * This class assumes that the DBus object has the usual victron layout. So
  * each object should have the methods GetValue, SetValue, and GetText as well
  * as the PropertiesChanged signal.
+ * All values published at once (see `setUpdateInterval`) are also reported
+ * by a single ItemsChanged signal on the root object of the service.
  */
 class DBusBridge : public QObject
 {
@@ -52,6 +87,21 @@ public:
 	void produce(QObject *src, const char *property, const QString &path,
 				 const QString &unit = QString(), int precision = -1);
 
+	/*!
+	 * \brief Same as above, with a policy to limit the number of updates.
+	 * The deadbands are only applied to numeric values. The minimum interval
+	 * and the maximum staleness are handled by the update timer, so they have
+	 * no effect if there's no update interval (see `setUpdateInterval`).
+	 */
+	void produce(QObject *src, const char *property, const QString &path,
+				 const PublishPolicy &policy, const QString &unit = QString(),
+				 int precision = -1);
+
+	/*!
+	 * \brief Changes the publish policy of a path created by `produce`.
+	 */
+	void setPublishPolicy(const QString &path, const PublishPolicy &policy);
+
 	/*!
 	 * \brief Pushes a constant value to the DBus, and registers the object.
 	 * `value` will be pushed (SetValue) to the DBus object specified by
@@ -79,6 +129,12 @@ public:
 	void consume(const QString &service,
 				 QObject *src, const char *property, const QString &path);
 
+	/*!
+	 * \brief Same as above, but creates the setting first.
+	 * The setting is created asynchronously. Settings added within the same
+	 * event loop iteration are sent to the settings service in a single
+	 * call. The DBus object is consumed when the reply comes in.
+	 */
 	void consume(const QString &service,
 				 QObject *src, const char *property,
 				 const QVariant &defaultValue, const QString &path);
@@ -87,12 +143,34 @@ public:
 				 QObject *src, const char *property, double defaultValue,
 				 double minValue, double maxValue, const QString &path);
 
+	/*!
+	 * \brief Same as above, for settings stored as integers.
+	 */
+	void consume(const QString &service,
+				 QObject *src, const char *property, int defaultValue,
+				 int minValue, int maxValue, const QString &path);
+
 	QString serviceName() const;
 
 	void setServiceName(const QString &sn);
 
 	void registerService();
 
+	/*!
+	 * Returns the number of values sent to the D-Bus by all bridges (each
+	 * results in a PropertiesChanged signal).
+	 */
+	static int propertiesChangedCount();
+
+	/*!
+	 * Returns the number of ItemsChanged signals sent by all bridges.
+	 */
+	static int itemsChangedCount();
+
+	/*!
+	 * Creates a setting in the settings service. Unlike `consume`, this
+	 * function blocks until the setting has been created.
+	 */
 	static bool addSetting(const QString &path, const QVariant &defaultValue,
 						   const QVariant &minValue, const QVariant &maxValue);
 
@@ -126,6 +204,14 @@ protected:
 	 */
 	virtual bool fromDBus(const QString &path, QVariant &v);
 
+	/*!
+	 * \brief Reports a change of the property connected to `path`.
+	 * For properties whose changes are reported by other means than their
+	 * notify signal (eg. a single signal for a group of properties). The value
+	 * is published as if the notify signal had been emitted.
+	 */
+	void setChanged(const QString &path);
+
 private slots:
 	void onPropertyChanged();
 
@@ -133,6 +219,10 @@ private slots:
 
 	void onUpdateTimer();
 
+	void onSendSettings();
+
+	void onSettingsAdded(QDBusPendingCallWatcher *watcher);
+
 private:
 	void connectItem(VBusItem *item, QObject *src, const char *property,
 					 const QString &path);
@@ -147,11 +237,73 @@ private:
 		QString path;
 		bool initialized;
 		bool changed;
+		PublishPolicy policy;
+		// Last value sent to the D-Bus, and the time it was sent
+		QVariant publishedValue;
+		QElapsedTimer publishTimer;
 	};
 
-	void publishValue(BusItemBridge &item);
+	/*!
+	 * Sends the value of `item` to the D-Bus, and adds it to `changes`.
+	 * Returns false if the value was rejected by `toDBus`, or if the change is
+	 * within the deadband of the policy (unless `force` is set).
+	 */
+	bool publishValue(BusItemBridge &item, VBusItemChanges &changes,
+					  bool force = false);
+
+	static bool withinDeadband(const PublishPolicy &policy,
+							   const QVariant &published,
+							   const QVariant &value);
+
+	void notifyItemsChanged(const VBusItemChanges &changes);
+
+	struct PendingSetting
+	{
+		QString service;
+		QObject *src;
+		QByteArray property;
+		QString path;
+		QVariant defaultValue;
+		QVariant minValue;
+		QVariant maxValue;
+	};
+
+	void addSetting(const QString &service, QObject *src, const char *property,
+					const QString &path, const QVariant &defaultValue,
+					const QVariant &minValue, const QVariant &maxValue);
+
+	/*!
+	 * Sends a separate `AddSetting` request for each setting. Used with
+	 * settings services that do not support `AddSettings`.
+	 */
+	void sendSettingsOneByOne(const QList<PendingSetting> &settings);
+
+	struct SettingsCall
+	{
+		// True for AddSettings, false for AddSetting
+		bool batch;
+		QList<PendingSetting> settings;
+	};
+
+	void watchSettingsCall(const QDBusPendingCall &call, bool batch,
+						   const QList<PendingSetting> &settings);
+
+	static QDBusMessage createAddSettingCall(const QString &path,
+											 const QVariant &defaultValue,
+											 const QVariant &minValue,
+											 const QVariant &maxValue);
 
 	QList<BusItemBridge> mBusItems;
+	typedef QPair<QObject *, int> SignalKey;
+	// Indices (in mBusItems) of the items connected to each notify signal. A
+	// notify signal may be shared by several properties.
+	QHash<SignalKey, QList<int> > mSignalItems;
+	// Indices (in mBusItems) of the items connected to a property, by path.
+	QHash<QString, int> mPathItems;
+	// Settings which have not been sent to the settings service yet.
+	QList<PendingSetting> mQueuedSettings;
+	// Settings sent to the settings service, waiting for the reply.
+	QHash<QDBusPendingCallWatcher *, SettingsCall> mSettingCalls;
 	QPointer<VBusNode> mServiceRoot;
 	QString mServiceName;
 	bool mServiceRegistered;
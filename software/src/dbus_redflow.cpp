@@ -1,33 +1,105 @@
 #include <QsLog.h>
+#include <QStringList>
+#include <QThread>
 #include "battery_controller_bridge.h"
 #include "battery_controller_settings.h"
 #include "battery_controller_settings_bridge.h"
-#include "battery_controller_updater.h"
+#include "bus_worker.h"
 #include "dbus_redflow.h"
 #include "dbus_service_monitor.h"
+#include "debug_bridge.h"
+#include "modbus_counters.h"
+#include "sample_trace.h"
 #include "settings.h"
 #include "settings_bridge.h"
+#include "statistics.h"
 #include "batteryController.h"
 
-DBusRedflow::DBusRedflow(const QString &portName, QObject *parent):
+DBusRedflow::DBusRedflow(const QStringList &portNames, int firstAddress,
+						 int lastAddress, bool statistics,
+						 const QString &recordFileName, QObject *parent):
 	QObject(parent),
 	/*mServiceMonitor(new DbusServiceMonitor("com.victronenergy.vebus", this)),*/
-	mModbus(new ModbusRtu(portName, 19200, this))
+	mServiceMonitor(new DbusServiceMonitor("com.victronenergy.settings", this)),
+	mStatistics(0),
+	mSampleTrace(new SampleTrace(this)),
+	mSettingsBridge(0)
 {
 	qRegisterMetaType<ConnectionState>();
-	qRegisterMetaType<QList<quint16> >();
-
-		BatteryController *m = new BatteryController(portName, 1 /*slave address*/, this);
-		new BatteryControllerUpdater(m, mModbus, m);
-				mBatteryController.append(m);
-		connect(m, SIGNAL(connectionStateChanged()),
-				this, SLOT(onConnectionStateChanged()));
-	
+	qRegisterMetaType<BatteryController *>();
+	qRegisterMetaType<ParameterSample>();
+	qRegisterMetaType<QList<int> >("QList<int>");
+
 	mSettings = new Settings(this);
-	new SettingsBridge(mSettings, this);
+	connect(mServiceMonitor, SIGNAL(servicesChanged()),
+			this, SLOT(onServicesChanged()));
+
+	if (statistics)
+		mStatistics = new Statistics(this);
+
+	// Start the search for batteries right away, without waiting for the
+	// settings service.
+	foreach (QString portName, portNames) {
+		QThread *thread = new QThread(this);
+		ModbusCounters *counters = 0;
+		if (mStatistics != 0) {
+			counters = new ModbusCounters();
+			mCounters.append(counters);
+			mStatistics->addBus(portName, counters);
+		}
+		BusWorker *worker = new BusWorker(portName, firstAddress, lastAddress,
+										  counters);
+		if (!recordFileName.isEmpty()) {
+			worker->setRecordFileName(portNames.size() == 1 ? recordFileName :
+				QString("%1.%2").arg(recordFileName).arg(mThreads.size()));
+		}
+		worker->setPollIntervals(mSettings->telemetryInterval(),
+								 mSettings->statusInterval());
+		worker->moveToThread(thread);
+		connect(thread, SIGNAL(finished()), worker, SLOT(deleteLater()));
+		connect(worker, SIGNAL(deviceFound(int)),
+				this, SLOT(onSlaveFound(int)));
+		connect(worker, SIGNAL(serialEvent(QString)),
+				this, SLOT(onSerialEvent(QString)));
+		thread->start();
+		QMetaObject::invokeMethod(worker, "start", Qt::QueuedConnection);
+		mThreads.append(thread);
+		mWorkers.append(worker);
+	}
+	connect(mSettings, SIGNAL(pollIntervalsChanged()),
+			this, SLOT(onPollIntervalsChanged()));
+	connect(mSettings, SIGNAL(knownDevicesChanged()),
+			this, SLOT(onKnownDevicesChanged()));
+	if (mStatistics != 0)
+		new DebugBridge(mStatistics, mSampleTrace, this);
+	onServicesChanged();
+}
+
+DBusRedflow::~DBusRedflow()
+{
+	// The updaters refer to the battery controllers, so the workers must be
+	// gone before the controllers are deleted.
+	foreach (QThread *thread, mThreads) {
+		thread->quit();
+		thread->wait();
+	}
+	qDeleteAll(mCounters);
+}
 
-	connect(mModbus, SIGNAL(serialEvent(const char *)),
-			this, SLOT(onSerialEvent(const char *)));
+void DBusRedflow::onSlaveFound(int slaveAddress)
+{
+	BusWorker *worker = static_cast<BusWorker *>(sender());
+	BatteryController *m = new BatteryController(worker->portName(),
+												  slaveAddress, this);
+	mBatteryController.append(m);
+	if (mStatistics != 0) {
+		int bus = mThreads.indexOf(worker->thread());
+		mStatistics->buses().at(bus)->addSlave(slaveAddress);
+	}
+	connect(m, SIGNAL(connectionStateChanged()),
+			this, SLOT(onConnectionStateChanged()));
+	QMetaObject::invokeMethod(worker, "addDevice", Qt::QueuedConnection,
+							  Q_ARG(BatteryController *, m));
 }
 
 void DBusRedflow::onConnectionStateChanged()
@@ -51,18 +123,31 @@ void DBusRedflow::onConnectionStateChanged()
 void DBusRedflow::onDeviceFound()
 {
 	BatteryController *m = static_cast<BatteryController *>(sender());
-	BatteryControllerUpdater *mu = m->findChild<BatteryControllerUpdater *>();
 	QLOG_INFO() << "Device found:" << m->serial()
 				<< '@' << m->portName();
-	BatteryControllerSettings *settings = mu->settings();
-	settings->setParent(m);
+	// The settings are deleted when the connection to the device is lost
+	// (see `onConnectionLost`).
+	BatteryControllerSettings *settings =
+			new BatteryControllerSettings(m->deviceType(), m->serial(), m);
 	connect(settings, SIGNAL(serviceTypeChanged()),
 			this, SLOT(onServiceTypeChanged()));
+	if (settingsAvailable())
+		createSettingsBridge(settings);
+	mSettings->registerDevice(m->serial());
+	mSettings->registerAddress(m->portName(), m->slaveAddress(), m->serial());
+}
+
+void DBusRedflow::createSettingsBridge(BatteryControllerSettings *settings)
+{
 	BatteryControllerSettingsBridge *b =
 			new BatteryControllerSettingsBridge(settings, settings);
 	connect(b, SIGNAL(initialized()),
 			this, SLOT(onDeviceSettingsInitialized()));
-	mSettings->registerDevice(m->serial());
+}
+
+bool DBusRedflow::settingsAvailable() const
+{
+	return !mServiceMonitor->services().isEmpty();
 }
 
 void DBusRedflow::onDeviceSettingsInitialized()
@@ -70,14 +155,14 @@ void DBusRedflow::onDeviceSettingsInitialized()
 	BatteryControllerSettingsBridge *b = static_cast<BatteryControllerSettingsBridge *>(sender());
 	BatteryControllerSettings *s = static_cast<BatteryControllerSettings *>(b->parent());
 	BatteryController *m = static_cast<BatteryController *>(s->parent());
-	BatteryControllerUpdater *mu = m->findChild<BatteryControllerUpdater *>();
+	Q_UNUSED(m)
 }
 
 void DBusRedflow::onDeviceInitialized()
 {
 	BatteryController *m = static_cast<BatteryController *>(sender());
-	BatteryControllerUpdater *mu = m->findChild<BatteryControllerUpdater *>();
-	new BatteryControllerBridge(m, mu->settings(), mSettings, m, mu);
+	BatteryControllerSettings *s = m->findChild<BatteryControllerSettings *>();
+	new BatteryControllerBridge(m, s, mSettings, m);
 }
 
 void DBusRedflow::onServiceTypeChanged()
@@ -85,7 +170,6 @@ void DBusRedflow::onServiceTypeChanged()
 	BatteryControllerSettings *s = static_cast<BatteryControllerSettings *>(sender());
 	BatteryController *m = static_cast<BatteryController *>(s->parent());
 	BatteryControllerBridge *bridge = m->findChild<BatteryControllerBridge *>();
-	BatteryControllerUpdater *mu = m->findChild<BatteryControllerUpdater *>();
 
 	if (bridge == 0) {
 		// Settings have not been fully initialized yet. We need to have all
@@ -95,7 +179,7 @@ void DBusRedflow::onServiceTypeChanged()
 	// Deleting and recreating the bridge will force recreation of the D-Bus
 	// service with another name.
 	delete bridge;
-	new BatteryControllerBridge(m, s, mSettings, m, mu);
+	new BatteryControllerBridge(m, s, mSettings, m);
 }
 
 void DBusRedflow::onControlLoopEnabledChanged()
@@ -105,10 +189,11 @@ void DBusRedflow::onControlLoopEnabledChanged()
 
 void DBusRedflow::onConnectionLost()
 {
-
+	BatteryController *m = static_cast<BatteryController *>(sender());
+	delete m->findChild<BatteryControllerSettings *>();
 }
 
-void DBusRedflow::onSerialEvent(const char *description)
+void DBusRedflow::onSerialEvent(const QString &description)
 {
 	QLOG_ERROR() << "Serial event:" << description
 				 << "Application will shut down.";
@@ -117,6 +202,51 @@ void DBusRedflow::onSerialEvent(const char *description)
 
 void DBusRedflow::onServicesChanged()
 {
+	if (mSettingsBridge != 0 || !settingsAvailable())
+		return;
+	QLOG_INFO() << "Local settings found";
+	mSettingsBridge = new SettingsBridge(mSettings, this);
+	connect(mSettingsBridge, SIGNAL(initialized()),
+			this, SLOT(onSettingsInitialized()));
+	// Batteries found before the settings service was available.
+	foreach (BatteryController *m, mBatteryController) {
+		BatteryControllerSettings *s =
+				m->findChild<BatteryControllerSettings *>();
+		if (s != 0 && s->findChild<BatteryControllerSettingsBridge *>() == 0)
+			createSettingsBridge(s);
+	}
+}
 
+void DBusRedflow::onSettingsInitialized()
+{
+	// The lists of device IDs and addresses retrieved from the settings
+	// service replace the lists created locally, so register the batteries
+	// found so far again.
+	foreach (BatteryController *m, mBatteryController) {
+		if (m->findChild<BatteryControllerSettings *>() != 0) {
+			mSettings->registerDevice(m->serial());
+			mSettings->registerAddress(m->portName(), m->slaveAddress(),
+									   m->serial());
+		}
+	}
 }
 
+void DBusRedflow::onPollIntervalsChanged()
+{
+	foreach (BusWorker *worker, mWorkers) {
+		QMetaObject::invokeMethod(worker, "setPollIntervals",
+								  Qt::QueuedConnection,
+								  Q_ARG(int, mSettings->telemetryInterval()),
+								  Q_ARG(int, mSettings->statusInterval()));
+	}
+}
+
+void DBusRedflow::onKnownDevicesChanged()
+{
+	foreach (BusWorker *worker, mWorkers) {
+		QList<int> addresses = mSettings->knownAddresses(worker->portName());
+		QMetaObject::invokeMethod(worker, "setPreferredAddresses",
+								  Qt::QueuedConnection,
+								  Q_ARG(QList<int>, addresses));
+	}
+}
@@ -3,19 +3,50 @@
 
 #include <QObject>
 #include <QList>
+#include <QStringList>
 
 class BatteryController;
+class BatteryControllerSettings;
 class BatteryControllerUpdater;
+class BusWorker;
 class ControlLoop;
 class DbusServiceMonitor;
-class ModbusRtu;
+struct ModbusCounters;
+class QThread;
+class SampleTrace;
 class Settings;
+class SettingsBridge;
+class Statistics;
 
 /*!
  * Main object which ties everything together.
- * This class will coordinate the search for new AC sensors, and start
- * acquisition when found. The class `AcSensorUpdater` is responsible for
- * communication with the sensors. Sensor data is stored in `AcSensor`.
+ * This class will coordinate the search for new battery controllers, and start
+ * acquisition when found. The class `BatteryControllerUpdater` is responsible
+ * for communication with the batteries. Battery data is stored in
+ * `BatteryController`.
+ *
+ * Multiple batteries may share one RS-485 bus. `ModbusRtu` keeps a queue per
+ * priority: control requests (writes from the D-Bus) are sent first, then
+ * telemetry, then status requests. After `MaxTelemetryBurst` telemetry
+ * requests, a pending status request is sent, so status polling does not
+ * starve on a busy bus.
+ *
+ * Each updater schedules its register groups against deadlines: telemetry
+ * groups are due every telemetry interval, status groups every status
+ * interval (see `Settings`). Groups whose values do not change are backed off
+ * up to a fixed multiple of their interval. The refresh interval of a battery
+ * is therefore the configured interval, unless the bus cannot serve all
+ * batteries in time; then the deadlines are missed and the interval grows
+ * with the number of batteries on the bus.
+ *
+ * A single process may serve several buses. Communication on each bus is
+ * handled by a `BusWorker` running in its own thread. The battery
+ * controllers, their settings, and the D-Bus services live in the main
+ * thread.
+ *
+ * The battery data is published as soon as it is available. Everything that
+ * depends on the settings service (com.victronenergy.settings) is held back
+ * until that service shows up on the D-Bus.
  *
  * The class will also make sure that the Hub-4 control loop is started when
  * apropriate. The control loop itself is implemented in `ControlLoop`.
@@ -27,12 +58,31 @@ class DBusRedflow : public QObject
 {
 	Q_OBJECT
 public:
-	DBusRedflow(const QString &portName, QObject *parent = 0);
+	/*!
+	 * Creates the application object.
+	 * @param portNames The communication ports (eg. /dev/ttyUSB0). Each port
+	 * may be shared by multiple battery controllers.
+	 * @param firstAddress, lastAddress The range of slave addresses that will
+	 * be searched for battery controllers on each port. A
+	 * `BatteryControllerUpdater` is created for every slave that responds.
+	 * All updaters of a port share the same `ModbusRtu` object.
+	 * @param statistics If true, performance statistics are collected and
+	 * published on the D-Bus (see `DebugBridge`).
+	 * @param recordFileName If not empty, all traffic is recorded to this
+	 * file. With multiple ports the index of the port is appended.
+	 */
+	DBusRedflow(const QStringList &portNames, int firstAddress,
+				int lastAddress, bool statistics = false,
+				const QString &recordFileName = QString(), QObject *parent = 0);
+
+	~DBusRedflow();
 
 signals:
 	void connectionLost();
 
 private slots:
+	void onSlaveFound(int slaveAddress);
+
 	void onDeviceFound();
 
 	void onDeviceSettingsInitialized();
@@ -43,21 +93,44 @@ private slots:
 
 	void onConnectionStateChanged();
 
-	void onSerialEvent(const char *description);
+	void onSerialEvent(const QString &description);
 
 	void onServicesChanged();
 
+	void onSettingsInitialized();
+
 	void onServiceTypeChanged();
 
 	void onControlLoopEnabledChanged();
 
+	void onPollIntervalsChanged();
+
+	void onKnownDevicesChanged();
+
 private:
 	void updateControlLoop();
 
+	/*!
+	 * Connects the settings of a battery to the settings service.
+	 */
+	void createSettingsBridge(BatteryControllerSettings *settings);
+
+	bool settingsAvailable() const;
+
 	DbusServiceMonitor *mServiceMonitor;
-	ModbusRtu *mModbus;
+	QList<QThread *> mThreads;
+	// Same order as `mThreads`. Each worker lives in its own thread.
+	QList<BusWorker *> mWorkers;
+	// Performance counters of each port (same order as `mThreads`). Empty if
+	// statistics are disabled.
+	QList<ModbusCounters *> mCounters;
+	Statistics *mStatistics;
+	// Recent values of all batteries, dumped to the log on request.
+	SampleTrace *mSampleTrace;
 	QList<BatteryController *> mBatteryController;
 	Settings *mSettings;
+	// Created when the settings service shows up.
+	SettingsBridge *mSettingsBridge;
 	QList<ControlLoop *> mControlLoops;
 };
 
@@ -5,6 +5,7 @@
 
 DbusServiceMonitor::DbusServiceMonitor(const QString &prefix, QObject *parent):
 	QObject(parent),
+	mName(prefix),
 	mPrefix(prefix + '.')
 {
 	QDBusConnectionInterface *ci = VBusItems::getConnection().interface();
@@ -34,7 +35,8 @@ void DbusServiceMonitor::onServiceOwnerChanged(const QString &name,
 
 void DbusServiceMonitor::processNewService(const QString &name)
 {
-	if (name.startsWith(mPrefix) && !mServices.contains(name)) {
+	if ((name == mName || name.startsWith(mPrefix)) &&
+		!mServices.contains(name)) {
 		mServices.append(name);
 		emit servicesChanged();
 	}
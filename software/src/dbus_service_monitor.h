@@ -5,7 +5,8 @@
 
 /*!
  * Monitors the presence of services whose name start with a known prefix (eg.
- * com.victronenergy.vebus).
+ * com.victronenergy.vebus). A service whose name equals the prefix (eg.
+ * com.victronenergy.settings) is also included.
  * The list of services is stored in the `services` property. The
  * `servicesChanged` signal will be raised whenever the service list changed.
  */
@@ -30,6 +31,7 @@ private:
 
 	void processOldService(const QString &name);
 
+	QString mName;
 	QString mPrefix;
 	QList<QString> mServices;
 };
@@ -0,0 +1,63 @@
+#include "debug_bridge.h"
+#include "sample_trace.h"
+#include "statistics.h"
+
+DebugBridge::DebugBridge(Statistics *statistics, SampleTrace *sampleTrace,
+						 QObject *parent):
+	DBusBridge("com.victronenergy.redflow.debug", parent)
+{
+	// The statistics are refreshed every second, so there's no need to send
+	// them more often.
+	setUpdateInterval(1000);
+
+	produce(statistics, "propertiesChangedRate",
+			"/Debug/Dbus/PropertiesChangedRate", "/s", 1);
+	produce(statistics, "itemsChangedRate",
+			"/Debug/Dbus/ItemsChangedRate", "/s", 1);
+	produce(sampleTrace, "dumpRequest", "/Debug/DumpTrace");
+	mBuses = statistics->buses();
+	for (int i=0; i<mBuses.size(); ++i) {
+		BusStatistics *bus = mBuses[i];
+		produceBus(bus, QString("/Debug/Modbus/%1").arg(i));
+		connect(bus, SIGNAL(slaveAdded(SlaveStatistics *)),
+				this, SLOT(onSlaveAdded(SlaveStatistics *)));
+	}
+
+	registerService();
+}
+
+void DebugBridge::onSlaveAdded(SlaveStatistics *slave)
+{
+	BusStatistics *bus = static_cast<BusStatistics *>(sender());
+	QString path = QString("/Debug/Modbus/%1/Slave/%2").
+			arg(mBuses.indexOf(bus)).
+			arg(slave->slaveAddress());
+	produceSlave(slave, path);
+}
+
+void DebugBridge::produceBus(BusStatistics *bus, const QString &path)
+{
+	produce(bus, "portName", path + "/Port");
+	produce(bus, "transactionRate", path + "/TransactionRate", "/s", 1);
+	produce(bus, "crcErrors", path + "/CrcErrors");
+	produce(bus, "timeouts", path + "/Timeouts");
+	produce(bus, "exceptions", path + "/Exceptions");
+	produce(bus, "exceptionCodes", path + "/ExceptionCodes");
+	produce(bus, "queueDepth", path + "/QueueDepth");
+	produce(bus, "maxQueueDepth", path + "/MaxQueueDepth");
+	produce(bus, "sweepTimeP50", path + "/SweepTime/P50", "ms", 1);
+	produce(bus, "sweepTimeP99", path + "/SweepTime/P99", "ms", 1);
+	foreach (SlaveStatistics *slave, bus->findChildren<SlaveStatistics *>())
+		produceSlave(slave, QString("%1/Slave/%2").arg(path).
+					 arg(slave->slaveAddress()));
+}
+
+void DebugBridge::produceSlave(SlaveStatistics *slave, const QString &path)
+{
+	produce(slave, "replies", path + "/Replies");
+	produce(slave, "latencyP50", path + "/Latency/P50", "ms", 1);
+	produce(slave, "latencyP90", path + "/Latency/P90", "ms", 1);
+	produce(slave, "latencyP99", path + "/Latency/P99", "ms", 1);
+	produce(slave, "pollInterval", path + "/PollInterval", "ms");
+	produce(slave, "targetPollInterval", path + "/TargetPollInterval", "ms");
+}
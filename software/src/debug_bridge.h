@@ -0,0 +1,40 @@
+#ifndef DEBUG_BRIDGE_H
+#define DEBUG_BRIDGE_H
+
+#include "dbus_bridge.h"
+
+class BusStatistics;
+class SampleTrace;
+class SlaveStatistics;
+class Statistics;
+
+/*!
+ * Publishes the performance statistics of the process on the D-Bus.
+ *
+ * D-Bus service: com.victronenergy.redflow.debug
+ * - /Debug/Dbus/...: updates sent to the D-Bus
+ * - /Debug/Modbus/<n>/...: statistics of the n-th Modbus connection
+ * - /Debug/Modbus/<n>/Slave/<address>/...: response times and achieved poll
+ *   interval of a single slave
+ * - /Debug/DumpTrace: write a non-zero value to dump the recent values of all
+ *   batteries to the log (see `SampleTrace`)
+ */
+class DebugBridge : public DBusBridge
+{
+	Q_OBJECT
+public:
+	DebugBridge(Statistics *statistics, SampleTrace *sampleTrace,
+				QObject *parent = 0);
+
+private slots:
+	void onSlaveAdded(SlaveStatistics *slave);
+
+private:
+	void produceBus(BusStatistics *bus, const QString &path);
+
+	void produceSlave(SlaveStatistics *slave, const QString &path);
+
+	QList<BusStatistics *> mBuses;
+};
+
+#endif // DEBUG_BRIDGE_H
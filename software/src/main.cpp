@@ -1,12 +1,15 @@
-#include <unistd.h>
 #include <QCoreApplication>
 #include <QsLog.h>
 #include <QStringList>
-#include <velib/qt/v_busitem.h>
 #include <velib/qt/v_busitems.h>
 #include "dbus_redflow.h"
 #include "version.h"
 
+// An RS-485 bus supports up to 32 unit loads, including the master. The
+// device instances of the batteries are based on this limit (see
+// `BatteryControllerBridge`).
+static const int MaxSlaveAddress = 31;
+
 void initLogger(QsLogging::Level logLevel)
 {
 	QsLogging::Logger &logger = QsLogging::Logger::instance();
@@ -23,20 +26,10 @@ void initLogger(QsLogging::Level logLevel)
 
 void initDBus(const QString &dbusAddress)
 {
+	// We do not wait for the settings service here. `DBusRedflow` holds back
+	// the parts that need the settings until the service shows up, so the
+	// batteries can be found (and their data published) in the mean time.
 	VBusItems::setDBusAddress(dbusAddress);
-
-	QLOG_INFO() << "Wait for local settings on DBus... ";
-	VBusItem settings;
-	settings.consume("com.victronenergy.settings", "/Settings/Vrmlogger/Url");
-	for (;;) {
-		QVariant reply = settings.getValue();
-		QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
-		if (reply.isValid())
-			break;
-		usleep(500000);
-		QLOG_INFO() << "Waiting...";
-	}
-	QLOG_INFO() << "Local settings found";
 }
 
 extern "C"
@@ -57,7 +50,13 @@ int main(int argc, char *argv[])
 
 	bool expectVerbosity = false;
 	bool expectDBusAddress = false;
-	QString portName;
+	bool expectSlaveAddress = false;
+	bool statistics = false;
+	bool expectRecordFile = false;
+	QString recordFile;
+	QStringList portNames;
+	int firstAddress = 1;
+	int lastAddress = 1;
 	QString dbusAddress = "system";
 	QStringList args = app.arguments();
 	args.pop_front();
@@ -73,6 +72,19 @@ int main(int argc, char *argv[])
 		} else if (expectDBusAddress) {
 			dbusAddress = arg;
 			expectDBusAddress = false;
+		} else if (expectRecordFile) {
+			recordFile = arg;
+			expectRecordFile = false;
+		} else if (expectSlaveAddress) {
+			QStringList range = arg.split('-');
+			firstAddress = range.first().toInt();
+			lastAddress = range.last().toInt();
+			if (range.size() > 2 || firstAddress < 1 ||
+				lastAddress > MaxSlaveAddress || firstAddress > lastAddress) {
+				QLOG_ERROR() << "Invalid slave address range:" << arg;
+				exit(2);
+			}
+			expectSlaveAddress = false;
 		} else if (arg == "-h" || arg == "--help") {
 			QLOG_INFO() << app.arguments().first();
 			QLOG_INFO() << "\t-h, --help";
@@ -83,8 +95,21 @@ int main(int argc, char *argv[])
 			QLOG_INFO() << "\t Set log level";
 			QLOG_INFO() << "\t-b, --dbus";
 			QLOG_INFO() << "\t dbus address or 'session' or 'system'";
-			QLOG_INFO() << "\t <Port Name>";
-			QLOG_INFO() << "\t Name of communication port (eg. /dev/ttyUSB0)";
+			QLOG_INFO() << "\t-a address, --address address";
+			QLOG_INFO() << "\t Slave address, or range of slave addresses to scan (eg. 1-12).";
+			QLOG_INFO() << "\t Addresses range from 1 to 31. Default is 1.";
+			QLOG_INFO() << "\t-s, --statistics";
+			QLOG_INFO() << "\t Publish performance statistics on the D-Bus";
+			QLOG_INFO() << "\t (com.victronenergy.redflow.debug).";
+			QLOG_INFO() << "\t-r file, --record file";
+			QLOG_INFO() << "\t Record all Modbus traffic to file.";
+			QLOG_INFO() << "\t <Port Name> [<Port Name> ...]";
+			QLOG_INFO() << "\t Name of communication port (eg. /dev/ttyUSB0), or address of";
+			QLOG_INFO() << "\t a Modbus TCP gateway (eg. tcp://192.168.1.10:502). Use";
+			QLOG_INFO() << "\t rtu+tcp://host:port for gateways which tunnel RTU frames.";
+			QLOG_INFO() << "\t Each port is served by its own thread.";
+			QLOG_INFO() << "\t Use replay:file to play back a recording, or";
+			QLOG_INFO() << "\t replay:file?fast to play it back as fast as possible.";
 			exit(1);
 		} else if (arg == "-V" || arg == "--version") {
 			QLOG_INFO() << VERSION << "(" REVISION ")";
@@ -96,21 +121,29 @@ int main(int argc, char *argv[])
 			logger.setIncludeTimestamp(true);
 		} else if (arg == "-b" || arg == "--dbus") {
 			expectDBusAddress = true;
+		} else if (arg == "-a" || arg == "--address") {
+			expectSlaveAddress = true;
+		} else if (arg == "-s" || arg == "--statistics") {
+			statistics = true;
+		} else if (arg == "-r" || arg == "--record") {
+			expectRecordFile = true;
 		} else if (!arg.startsWith('-')) {
-			portName = arg;
+			portNames.append(arg);
 		}
 	}
 
-	if (portName.isEmpty()) {
+	if (portNames.isEmpty()) {
 		QLOG_ERROR() << "No communication port specified on command line";
 		exit(2);
 	} else {
-		QLOG_INFO() << "Connecting to" << portName;
+		QLOG_INFO() << "Connecting to" << portNames.join(", ")
+					<< "slave address" << firstAddress << "to" << lastAddress;
 	}
 
 	initDBus(dbusAddress);
 
-	DBusRedflow a(portName);
+	DBusRedflow a(portNames, firstAddress, lastAddress, statistics,
+				  recordFile);
 
 	app.connect(&a, SIGNAL(connectionLost()), &app, SLOT(quit()));
 
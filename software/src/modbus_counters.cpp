@@ -0,0 +1,68 @@
+#include "modbus_counters.h"
+
+LatencyHistogram::LatencyHistogram()
+{
+}
+
+void LatencyHistogram::add(qint64 us)
+{
+	mBuckets[bucketIndex(us)].fetchAndAddRelaxed(1);
+	mCount.fetchAndAddRelaxed(1);
+}
+
+int LatencyHistogram::count() const
+{
+	return mCount;
+}
+
+int LatencyHistogram::percentile(int percentile) const
+{
+	int total = mCount;
+	if (total == 0)
+		return 0;
+	// Number of samples at or below the requested percentile (rounded up)
+	qint64 rank = (static_cast<qint64>(total) * percentile + 99) / 100;
+	qint64 sum = 0;
+	for (int i=0; i<BucketCount; ++i) {
+		sum += mBuckets[i];
+		if (sum >= rank)
+			return bucketUpperBound(i);
+	}
+	// Samples added while we were summing
+	return bucketUpperBound(BucketCount - 1);
+}
+
+int LatencyHistogram::bucketIndex(qint64 us)
+{
+	if (us < 2)
+		return 0;
+	int msb = 0;
+	while ((us >> (msb + 1)) != 0)
+		++msb;
+	// Each power of 2 is split in 2 halves, selected by the bit below the
+	// most significant bit.
+	int index = 2 * msb - 1 + static_cast<int>((us >> (msb - 1)) & 1);
+	return qMin(index, static_cast<int>(BucketCount) - 1);
+}
+
+int LatencyHistogram::bucketUpperBound(int index)
+{
+	if (index == 0)
+		return 2;
+	int msb = (index + 1) / 2;
+	int half = (index + 1) % 2;
+	return (1 << msb) + (half + 1) * (1 << (msb - 1));
+}
+
+ModbusCounters::ModbusCounters()
+{
+}
+
+void ModbusCounters::setQueueDepth(int depth)
+{
+	queueDepth = depth;
+	// Another thread only reads the maximum, so there is no need for a
+	// compare and swap loop here.
+	if (depth > maxQueueDepth)
+		maxQueueDepth = depth;
+}
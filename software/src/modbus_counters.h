@@ -0,0 +1,77 @@
+#ifndef MODBUS_COUNTERS_H
+#define MODBUS_COUNTERS_H
+
+#include <QAtomicInt>
+#include <QtGlobal>
+
+/*!
+ * Histogram of durations in microseconds.
+ * There are 2 buckets per power of 2, so the percentiles are accurate up to
+ * 25%. Adding a sample does not allocate memory, and all buckets are atomic,
+ * so the histogram may be read from another thread.
+ */
+class LatencyHistogram
+{
+public:
+	LatencyHistogram();
+
+	void add(qint64 us);
+
+	/*!
+	 * Returns the number of samples added.
+	 */
+	int count() const;
+
+	/*!
+	 * Returns the upper bound (in microseconds) of the bucket containing the
+	 * `percentile`th percentile of all samples, or 0 if there are no samples.
+	 */
+	int percentile(int percentile) const;
+
+	enum {
+		// The last bucket holds all durations of 1.5 * 2^23 us (12.6s) and more.
+		BucketCount = 47
+	};
+
+	static int bucketIndex(qint64 us);
+
+	static int bucketUpperBound(int index);
+
+private:
+	QAtomicInt mBuckets[BucketCount];
+	QAtomicInt mCount;
+};
+
+/*!
+ * Performance counters of a single Modbus connection.
+ * The counters are updated by `ModbusRtu` and `BatteryControllerUpdater` in
+ * the thread of the connection, and read from the main thread. All counters
+ * are cumulative. Rates are computed by the reader.
+ */
+struct ModbusCounters
+{
+	ModbusCounters();
+
+	/// Number of requests sent
+	QAtomicInt transactions;
+	QAtomicInt crcErrors;
+	QAtomicInt timeouts;
+	/// Number of exception replies, indexed by exception code
+	QAtomicInt exceptions[16];
+	/// Number of requests waiting to be sent
+	QAtomicInt queueDepth;
+	QAtomicInt maxQueueDepth;
+	/// Time between sending a request and receiving the reply, per slave
+	LatencyHistogram latency[256];
+	/// Time needed to retrieve all registers of a battery once
+	LatencyHistogram sweepTime;
+	/// Achieved interval (ms) between 2 reads of the telemetry, per slave
+	/// (moving average).
+	QAtomicInt pollInterval[256];
+	/// Configured telemetry interval (ms), per slave
+	QAtomicInt targetPollInterval[256];
+
+	void setQueueDepth(int depth);
+};
+
+#endif // MODBUS_COUNTERS_H
@@ -1,209 +1,471 @@
+#include <string.h>
 #include <QTimer>
-#include <QsLog.h>
-#include <unistd.h>
 #include "defines.h"
 #include "modbus_rtu.h"
 
-ModbusRtu::ModbusRtu(const QString &portName, int baudrate,
-					 QObject *parent):
+static const int DefaultMinTimeout = 50;
+static const int DefaultMaxTimeout = 2000;
+static const int DefaultProbeTimeout = 300;
+// Number of mean deviations added to the smoothed turnaround time
+static const int DeviationFactor = 4;
+// Maximum number of timeout doublings after consecutive timeouts
+static const int MaxBackoff = 3;
+// Maximum number of telemetry requests sent while status requests are waiting
+static const int MaxTelemetryBurst = 4;
+
+ModbusRtu::ModbusRtu(ModbusTransport *transport, QObject *parent):
 	QObject(parent),
-	mPortName(portName.toLatin1()),
+	mTransport(transport),
+	mFraming(transport->framing()),
+	mMaxInFlight(qBound(1, transport->maxInFlight(), static_cast<int>(MaxInFlight))),
 	mTimer(new QTimer(this)),
-	mCurrentSlave(0)
+	mGapTimer(new QTimer(this)),
+	mMinTimeout(DefaultMinTimeout),
+	mMaxTimeout(DefaultMaxTimeout),
+	mProbeTimeout(DefaultProbeTimeout),
+	mTelemetryBurst(0),
+	mCounters(0)
 {
-	memset(&mSerialPort, 0, sizeof(mSerialPort));
-	// The pointer returned by mPortName.data() will remain valid as long as
-	// mPortName exists and is not changed.
-	mSerialPort.dev = mPortName.data();
-	mSerialPort.baudrate = baudrate;
-	mSerialPort.intLevel = 2;
-	mSerialPort.rxCallback = onDataRead;
-	mSerialPort.eventCallback = onSerialEvent;
-	veSerialOpen(&mSerialPort, this);
+	mTransport->setParent(this);
+	// Both signals may be emitted from the reader thread of the serial port.
+	connect(mTransport, SIGNAL(dataReceived(const quint8 *, int)),
+			this, SLOT(onDataReceived(const quint8 *, int)),
+			Qt::DirectConnection);
+	connect(mTransport, SIGNAL(transportError(const char *)),
+			this, SIGNAL(serialEvent(const char *)),
+			Qt::DirectConnection);
 
-	mData.reserve(16);
+	mTxLength = 0;
+	mNextTransactionId = 0;
+	mInFlight = 0;
+	mCurrentTransaction = -1;
+	mRxLength = 0;
+	mFrameLength = 0;
+	mCrcValid = false;
+	mResync = false;
+	for (int p=0; p<PriorityCount; ++p)
+		mPendingCommands[p].reserve(16);
+	memset(mSlaveTiming, 0, sizeof(mSlaveTiming));
+	memset(&mBusTiming, 0, sizeof(mBusTiming));
 
+	mClock.start();
 	resetStateEngine();
-	mTimer->setInterval(2000);
+	mTimer->setSingleShot(true);
 	connect(mTimer, SIGNAL(timeout()), this, SLOT(onTimeout()));
+	mGapTimer->setSingleShot(true);
+	connect(mGapTimer, SIGNAL(timeout()), this, SLOT(transmit()));
+}
+
+void ModbusRtu::setTimeoutBounds(int minTimeout, int maxTimeout)
+{
+	Q_ASSERT(minTimeout > 0 && minTimeout <= maxTimeout);
+	mMinTimeout = minTimeout;
+	mMaxTimeout = maxTimeout;
+}
+
+int ModbusRtu::minTimeout() const
+{
+	return mMinTimeout;
+}
+
+int ModbusRtu::maxTimeout() const
+{
+	return mMaxTimeout;
+}
+
+void ModbusRtu::setProbeTimeout(int timeout)
+{
+	Q_ASSERT(timeout > 0);
+	mProbeTimeout = timeout;
+}
+
+int ModbusRtu::probeTimeout() const
+{
+	return mProbeTimeout;
+}
+
+int ModbusRtu::maxInFlight() const
+{
+	return mMaxInFlight;
 }
 
-ModbusRtu::~ModbusRtu()
+ModbusRtu::RoundTripStats ModbusRtu::roundTripStats(quint8 slaveAddress) const
 {
-	veSerialClose(&mSerialPort);
+	const SlaveTiming &timing = mSlaveTiming[slaveAddress];
+	RoundTripStats stats;
+	stats.samples = timing.samples;
+	stats.turnaround = static_cast<int>(timing.turnaround);
+	stats.turnaroundDeviation = static_cast<int>(timing.deviation);
+	// Use the reply length of a single register read as reference
+	stats.timeout = responseTimeout(slaveAddress, 8, 7);
+	return stats;
 }
 
 void ModbusRtu::readRegisters(FunctionCode function, quint8 slaveAddress,
-							  quint16 startReg, quint16 count)
+							  quint16 startReg, quint16 count,
+							  Priority priority)
 {
-	if (mState == Idle) {
+	if (canSend()) {
 		_readRegisters(function, slaveAddress, startReg, count);
-	} else {
-		Cmd cmd;
-		cmd.function = function;
-		cmd.slaveAddress = slaveAddress;
-		cmd.reg = startReg;
-		cmd.value = count;
-		mPendingCommands.append(cmd);
+		return;
 	}
+	// Skip the request if it is already queued. If the queued request has a
+	// lower priority, move it up.
+	for (int p=0; p<PriorityCount; ++p) {
+		QVector<Cmd> &queue = mPendingCommands[p];
+		for (int i=0; i<queue.size(); ++i) {
+			const Cmd cmd = queue.at(i);
+			if (cmd.function == function && cmd.slaveAddress == slaveAddress &&
+				cmd.reg == startReg && cmd.value == count) {
+				if (p > priority) {
+					queue.remove(i);
+					mPendingCommands[priority].append(cmd);
+				}
+				return;
+			}
+		}
+	}
+	enqueue(function, slaveAddress, startReg, count, priority);
 }
 
 void ModbusRtu::writeRegister(FunctionCode function, quint8 slaveAddress,
-							  quint16 reg, quint16 value)
+							  quint16 reg, quint16 value, Priority priority)
 {
-	if (mState == Idle) {
+	if (canSend())
 		_writeRegister(function, slaveAddress, reg, value);
-	} else {
-		Cmd cmd;
-		cmd.function = function;
-		cmd.slaveAddress = slaveAddress;
-		cmd.reg	= reg;
-		cmd.value = value;
-		mPendingCommands.append(cmd);
-	}
+	else
+		enqueue(function, slaveAddress, reg, value, priority);
+}
+
+int ModbusRtu::pendingCount() const
+{
+	int count = 0;
+	for (int p=0; p<PriorityCount; ++p)
+		count += mPendingCommands[p].size();
+	return count;
+}
+
+void ModbusRtu::setCounters(ModbusCounters *counters)
+{
+	mCounters = counters;
+}
+
+ModbusCounters *ModbusRtu::counters() const
+{
+	return mCounters;
 }
 
 void ModbusRtu::onTimeout()
 {
-	if (mState == Idle || mState == Process)
+	// Timeouts are not handled while a reply is being processed, because the
+	// transaction of that reply must not be removed. The timer is restarted
+	// when processing has finished.
+	if (mState != WaitForReply)
 		return;
-	int cs = mCurrentSlave;
-	resetStateEngine();
+	qint64 now = mClock.elapsed();
+	quint8 expired[MaxInFlight];
+	int expiredCount = 0;
+	for (int i=0; i<mInFlight;) {
+		const Transaction &t = mTransactions[i];
+		if (t.deadline > now) {
+			++i;
+			continue;
+		}
+		// Back off, so a slow (instead of dead) slave will get a longer
+		// timeout next time. Slaves that never replied are not slow, so
+		// there's no need to back off.
+		SlaveTiming &timing = mSlaveTiming[t.slaveAddress];
+		if (timing.samples > 0 && timing.backoff < MaxBackoff)
+			++timing.backoff;
+		expired[expiredCount++] = t.slaveAddress;
+		removeTransaction(i);
+	}
+	if (mCounters != 0)
+		mCounters->timeouts.fetchAndAddRelaxed(expiredCount);
+	if (mInFlight == 0)
+		resetStateEngine();
+	else
+		startResponseTimer();
 	processPending();
-	emit errorReceived(Timeout, cs, 0);
+	for (int i=0; i<expiredCount; ++i)
+		emit errorReceived(Timeout, expired[i], 0);
 }
 
 void ModbusRtu::processPacket()
 {
-	int cs = mCurrentSlave;
-	if (mCrc != mCrcBuilder.getValue()) {
-		resetStateEngine();
-		processPending();
+	const Transaction &t = mTransactions[mCurrentTransaction];
+	quint8 cs = t.slaveAddress;
+	// Any reply (including exceptions and replies with CRC errors) tells us
+	// something about the response time of the slave.
+	qint64 roundTrip = t.roundTripTimer.nsecsElapsed() / 1000;
+	qint64 turnaround = roundTrip -
+			(t.requestLength + mFrameLength) * characterTime();
+	addTurnaroundSample(mSlaveTiming[cs], turnaround);
+	addTurnaroundSample(mBusTiming, turnaround);
+	const quint8 *pdu = mRxFrame +
+			(mFraming == ModbusTransport::MbapFraming ? MbapHeaderSize : 1);
+	quint8 function = pdu[0];
+	if (mCounters != 0) {
+		mCounters->latency[cs].add(roundTrip);
+		if (!mCrcValid)
+			mCounters->crcErrors.fetchAndAddRelaxed(1);
+		else if ((function & 0x80) != 0)
+			mCounters->exceptions[pdu[1] & 0x0F].fetchAndAddRelaxed(1);
+	}
+	// The signals below are emitted before the next request is sent, because
+	// the values passed refer to the receive buffer. Requests issued by the
+	// receivers of the signals will be queued, since we are still in the
+	// `Process` state.
+	if (!mCrcValid) {
 		emit errorReceived(CrcError, cs, 0);
-	} else if ((mFunction & 0x80) != 0) {
-		quint8 errorCode = mData[0];
-		resetStateEngine();
-		processPending();
-		emit errorReceived(Exception, cs, errorCode);
-	} else if (mState == Function) {
-		resetStateEngine();
-		processPending();
-		emit errorReceived(Unsupported, cs, mFunction);
+	} else if ((function & 0x80) != 0) {
+		emit errorReceived(Exception, cs, pdu[1]);
 	} else {
-		FunctionCode function = mFunction;
 		switch (function) {
 		case ReadHoldingRegisters:
 		case ReadInputRegisters:
-		{
-			QList<quint16> registers;
-			for (int i=0; i<mData.length(); i+=2) {
-				registers.append(toUInt16(mData[i], mData[i + 1]));
-			}
-			resetStateEngine();
-			processPending();
-			emit readCompleted(function, cs, registers);
+			emit readCompleted(function, cs, RegisterSpan(pdu + 2, pdu[1] / 2));
 			break;
-		}
 		case WriteSingleRegister:
-		{
-			quint16 value = toUInt16(mData[0], mData[1]);
-			resetStateEngine();
-			processPending();
-			emit writeCompleted(function, cs, mStartAddress, value);
+			emit writeCompleted(function, cs, toUInt16(pdu[1], pdu[2]),
+								toUInt16(pdu[3], pdu[4]));
 			break;
-		}
 		default:
+			emit errorReceived(Unsupported, cs, function);
 			break;
 		}
 	}
+	removeTransaction(mCurrentTransaction);
+	mCurrentTransaction = -1;
+	if (mFraming == ModbusTransport::RtuFraming) {
+		resetStateEngine();
+		processPending();
+		return;
+	}
+	// Remove the reply from the buffer. Replies to other pending requests
+	// may follow.
+	mRxLength -= mFrameLength;
+	memmove(mRxFrame, mRxFrame + mFrameLength, mRxLength);
+	mState = mInFlight > 0 ? WaitForReply : Idle;
+	startResponseTimer();
+	processPending();
+	parseFrames();
 }
 
-void ModbusRtu::handleByteRead(quint8 b)
+void ModbusRtu::onDataReceived(const quint8 *data, int length)
 {
-	if (mAddToCrc)
-		mCrcBuilder.add(b);
-	switch (mState) {
-	case Idle:
-	case Process:
-		// We received data when we were not expecting any. Ignore the data.
-		break;
-	case Address:
-		if (b == mCurrentSlave)
-			mState = Function;
-		break;
-	case Function:
-		mFunction = static_cast<FunctionCode>(b);
-		if ((mFunction & 0x80) != 0) {
-			// Exception
-			mCount = 1;
-			mState = Data;
-			mData.clear();
+	// With Modbus RTU everything received while we are not waiting for a
+	// reply is ignored. A TCP stream may contain the start of the next reply,
+	// or a late reply, so everything is kept.
+	if (mFraming == ModbusTransport::RtuFraming && mState != WaitForReply)
+		return;
+	if (mState == Process) {
+		// The reply at the start of the buffer is being processed, so we can
+		// only append. The buffer is large enough for the replies to all
+		// pending requests.
+		length = qMin(length, RxBufferSize - mRxLength);
+		memcpy(mRxFrame + mRxLength, data, length);
+		mRxLength += length;
+		return;
+	}
+	// Add the data to the receive buffer. If the buffer is full the oldest
+	// data is dropped, because it cannot be part of a valid reply.
+	if (length >= RxBufferSize) {
+		data += length - RxBufferSize;
+		length = RxBufferSize;
+		mRxLength = 0;
+		mResync = true;
+	} else if (mRxLength + length > RxBufferSize) {
+		dropBytes(mRxLength + length - RxBufferSize);
+	}
+	memcpy(mRxFrame + mRxLength, data, length);
+	mRxLength += length;
+	parseFrames();
+}
+
+void ModbusRtu::parseFrames()
+{
+	for (;;) {
+		int transaction = 0;
+		int frameLength = 0;
+		if (mFraming == ModbusTransport::MbapFraming) {
+			frameLength = mbapReplyLength(transaction);
 		} else {
-			switch (mFunction) {
-			case ReadHoldingRegisters:
-			case ReadInputRegisters:
-				mState = ByteCount;
-				break;
-			case WriteSingleRegister:
-				mState = StartAddressMsb;
-				break;
-			default:
-				mState = Address;
-				break;
-			}
+			// Skip everything before the address of the slave we are waiting
+			// for.
+			int start = 0;
+			while (start < mRxLength &&
+				   mRxFrame[start] != mTransactions[0].slaveAddress)
+				++start;
+			dropBytes(start);
+			frameLength = replyLength();
 		}
-		break;
-	case ByteCount:
-		mCount = b;
-		mState = mCount == 0 ? CrcMsb : Data;
-		mData.clear();
-		break;
-	case StartAddressMsb:
-		mStartAddress = b << 8;
-		mState = StartAddressLsb;
-		break;
-	case StartAddressLsb:
-		mStartAddress |= b;
-		mCount = 2;
-		mState = Data;
-		mData.clear();
-		break;
-	case Data:
-		if (mCount > 0) {
-			mData.append(b);
-			--mCount;
+		if (frameLength < 0) {
+			// Not a reply to our request. Search for the next candidate.
+			dropBytes(1);
+			continue;
 		}
-		if (mCount == 0) {
-			mState = CrcMsb;
-			mAddToCrc = false;
+		if (frameLength == 0 || frameLength > mRxLength)
+			return; // Wait for more data
+		if (transaction < 0) {
+			// Reply to a request which has timed out already.
+			dropBytes(frameLength);
+			continue;
 		}
-		break;
-	case CrcMsb:
-		mCrc = b << 8;
-		mState = CrcLsb;
-		break;
-	case CrcLsb:
-		mCrc |= b;
+		mCrcValid = true;
+		if (mFraming == ModbusTransport::RtuFraming) {
+			quint16 crc = toUInt16(mRxFrame[frameLength - 2], mRxFrame[frameLength - 1]);
+			mCrcValid = crc == Crc16::getValue(mRxFrame, frameLength - 2);
+			if (!mCrcValid && mResync) {
+				// We have been skipping garbage, so this is probably not a
+				// real reply. A reply without preceding garbage and with a
+				// CRC error will be reported.
+				dropBytes(1);
+				continue;
+			}
+		}
+		mFrameLength = frameLength;
+		mCurrentTransaction = transaction;
 		mState = Process;
-		QMetaObject::invokeMethod(this, "processPacket");
-		break;
+		QMetaObject::invokeMethod(this, "processPacket", Qt::QueuedConnection);
+		return;
+	}
+}
+
+int ModbusRtu::replyLength() const
+{
+	if (mInFlight == 0 || mRxLength < 2)
+		return 0;
+	quint8 function = mRxFrame[1];
+	quint8 requested = mTransactions[0].function;
+	if (function == (requested | 0x80))
+		return 5; // Address, function, exception code, and CRC
+	if (function != requested)
+		return -1;
+	switch (function) {
+	case ReadHoldingRegisters:
+	case ReadInputRegisters:
+	{
+		if (mRxLength < 3)
+			return 0;
+		int byteCount = mRxFrame[2];
+		if (byteCount % 2 != 0 || byteCount + 5 > MaxAduSize)
+			return -1;
+		return byteCount + 5;
+	}
+	case WriteSingleRegister:
+		return 8;
+	default:
+		return -1;
+	}
+}
+
+int ModbusRtu::mbapReplyLength(int &transaction) const
+{
+	transaction = -1;
+	// Header, function code, and exception code or byte count
+	if (mRxLength < MbapHeaderSize + 2)
+		return 0;
+	if (mRxFrame[2] != 0 || mRxFrame[3] != 0)
+		return -1; // Protocol ID should be 0
+	// Length of unit ID and PDU
+	int length = toUInt16(mRxFrame[4], mRxFrame[5]);
+	if (length < 3 || MbapHeaderSize - 1 + length > MaxAduSize)
+		return -1;
+	const quint8 *pdu = mRxFrame + MbapHeaderSize;
+	quint8 function = pdu[0];
+	if ((function == ReadHoldingRegisters || function == ReadInputRegisters) &&
+		pdu[1] + 3 != length)
+		return -1;
+	quint16 id = toUInt16(mRxFrame[0], mRxFrame[1]);
+	for (int i=0; i<mInFlight; ++i) {
+		const Transaction &t = mTransactions[i];
+		if (t.id == id && (function == t.function || function == (t.function | 0x80))) {
+			transaction = i;
+			break;
+		}
 	}
+	return MbapHeaderSize - 1 + length;
+}
+
+void ModbusRtu::dropBytes(int count)
+{
+	if (count <= 0)
+		return;
+	count = qMin(count, mRxLength);
+	mRxLength -= count;
+	memmove(mRxFrame, mRxFrame + count, mRxLength);
+	mResync = true;
+}
+
+void ModbusRtu::removeTransaction(int index)
+{
+	Q_ASSERT(index >= 0 && index < mInFlight);
+	--mInFlight;
+	for (int i=index; i<mInFlight; ++i)
+		mTransactions[i] = mTransactions[i + 1];
 }
 
 void ModbusRtu::resetStateEngine()
 {
 	mState = Idle;
-	mCrcBuilder.reset();
-	mAddToCrc = true;
-	mCurrentSlave = 0;
+	if (mFraming == ModbusTransport::RtuFraming)
+		mRxLength = 0;
 	mTimer->stop();
+	// The bus has become silent at this point at the latest (either a reply
+	// has been received or the request has timed out).
+	mBusIdleTimer.start();
 }
 
-void ModbusRtu::processPending()
+void ModbusRtu::startResponseTimer()
 {
-	if (mPendingCommands.isEmpty())
+	if (mInFlight == 0) {
+		mTimer->stop();
 		return;
-	const Cmd &cmd = mPendingCommands.first();
+	}
+	qint64 deadline = mTransactions[0].deadline;
+	for (int i=1; i<mInFlight; ++i)
+		deadline = qMin(deadline, mTransactions[i].deadline);
+	mTimer->start(static_cast<int>(qMax<qint64>(0, deadline - mClock.elapsed())));
+}
+
+bool ModbusRtu::canSend() const
+{
+	return (mState == Idle || mState == WaitForReply) && mInFlight < mMaxInFlight;
+}
+
+void ModbusRtu::processPending()
+{
+	while (canSend() && sendPending()) {
+	}
+}
+
+bool ModbusRtu::sendPending()
+{
+	// Control requests are always sent first. Telemetry requests go before
+	// status requests, but status requests will not starve when there are
+	// many batteries on the bus.
+	int priority = ControlPriority;
+	while (priority < PriorityCount && mPendingCommands[priority].isEmpty())
+		++priority;
+	if (priority == PriorityCount)
+		return false;
+	if (priority == TelemetryPriority) {
+		if (mTelemetryBurst >= MaxTelemetryBurst &&
+			!mPendingCommands[StatusPriority].isEmpty()) {
+			priority = StatusPriority;
+			mTelemetryBurst = 0;
+		} else {
+			++mTelemetryBurst;
+		}
+	} else if (priority == StatusPriority) {
+		mTelemetryBurst = 0;
+	}
+	QVector<Cmd> &queue = mPendingCommands[priority];
+	Cmd cmd = queue.first();
+	queue.remove(0);
+	if (mCounters != 0)
+		mCounters->setQueueDepth(pendingCount());
 	switch (cmd.function) {
 	case ReadHoldingRegisters:
 	case ReadInputRegisters:
@@ -215,75 +477,167 @@ void ModbusRtu::processPending()
 	default:
 		break;
 	}
-	mPendingCommands.removeFirst();
+	return true;
+}
+
+void ModbusRtu::enqueue(FunctionCode function, quint8 slaveAddress,
+						quint16 reg, quint16 value, Priority priority)
+{
+	Cmd cmd;
+	cmd.function = function;
+	cmd.slaveAddress = slaveAddress;
+	cmd.reg = reg;
+	cmd.value = value;
+	mPendingCommands[priority].append(cmd);
+	if (mCounters != 0)
+		mCounters->setQueueDepth(pendingCount());
 }
 
 void ModbusRtu::_readRegisters(ModbusRtu::FunctionCode function,
 							   quint8 slaveAddress, quint16 startReg,
 							   quint16 count)
 {
-	Q_ASSERT(mState == Idle);
-	QByteArray frame;
-	frame.reserve(8);
-	frame.append(slaveAddress);
-	frame.append(function);
-	frame.append(msb(startReg));
-	frame.append(lsb(startReg));
-	frame.append(msb(count));
-	frame.append(lsb(count));
-	send(frame);
+	quint8 *pdu = beginFrame(slaveAddress);
+	pdu[0] = function;
+	pdu[1] = msb(startReg);
+	pdu[2] = lsb(startReg);
+	pdu[3] = msb(count);
+	pdu[4] = lsb(count);
+	send(5);
 }
 
 void ModbusRtu::_writeRegister(ModbusRtu::FunctionCode function,
 							   quint8 slaveAddress, quint16 reg, quint16 value)
 {
-	Q_ASSERT(mState == Idle);
-	QByteArray frame;
-	frame.reserve(8);
-	frame.append(slaveAddress);
-	frame.append(function);
-	frame.append(msb(reg));
-	frame.append(lsb(reg));
-	frame.append(msb(value));
-	frame.append(lsb(value));
-	send(frame);
-}
-
-void ModbusRtu::send(QByteArray &data)
-{
-	Q_ASSERT(mState == Idle);
-	quint16 crc = Crc16::getValue(data);
-	data.append(msb(crc));
-	data.append(lsb(crc));
-	// Modbus requires a pause between sending of 3.5 times the interval needed
-	// to send a character. We use 4 characters here, just in case...
-	// We also assume 10 bits per caracter (8 data bits, 1 stop bit and 1 parity
-	// bit). Keep in mind that overestimating the charcter time does not hurt
-	// (a lot), but underestimating does.
-	// Then number of bits devided by the the baudrate (unit: bits/second) gives
-	// us the time in seconds. usleep wants time in microseconds, so we have to
-	// multiply by 1 million.
-	usleep((4 * 10 * 1000 * 1000) / mSerialPort.baudrate);
-	veSerialPutBuf(&mSerialPort, (quint8 *)data.data(), data.size());
-	mTimer->start();
-	mState = Address;
-	mCurrentSlave = static_cast<int>(data[0]);
-}
-
-void ModbusRtu::onDataRead(VeSerialPortS *port, const quint8 *buffer,
-						   quint32 length)
-{
-	ModbusRtu *rtu = reinterpret_cast<ModbusRtu *>(port->ctx);
-	for (quint32 i=0; i<length; ++i)
-		rtu->handleByteRead(buffer[i]);
-}
-
-void ModbusRtu::onSerialEvent(VeSerialPortS *port, VeSerialEvent event,
-							  const char *desc)
-{
-	QLOG_INFO() << "onSerialEvent";
-	Q_UNUSED(port);
-	Q_UNUSED(event);
-	ModbusRtu *rtu = reinterpret_cast<ModbusRtu *>(port->ctx);
-	emit rtu->serialEvent(desc);
+	quint8 *pdu = beginFrame(slaveAddress);
+	pdu[0] = function;
+	pdu[1] = msb(reg);
+	pdu[2] = lsb(reg);
+	pdu[3] = msb(value);
+	pdu[4] = lsb(value);
+	send(5);
+}
+
+quint8 *ModbusRtu::beginFrame(quint8 slaveAddress)
+{
+	Q_ASSERT(canSend());
+	if (mFraming == ModbusTransport::MbapFraming) {
+		// Transaction ID and length are set in `send`.
+		mTxFrame[2] = 0; // Protocol ID
+		mTxFrame[3] = 0;
+		mTxFrame[6] = slaveAddress; // Unit ID
+		return mTxFrame + MbapHeaderSize;
+	}
+	mTxFrame[0] = slaveAddress;
+	return mTxFrame + 1;
+}
+
+void ModbusRtu::send(int pduLength)
+{
+	Q_ASSERT(canSend());
+	// The transaction is added to the list in `transmit`.
+	Transaction &t = mTransactions[mInFlight];
+	t.id = mNextTransactionId++;
+	if (mFraming == ModbusTransport::MbapFraming) {
+		Q_ASSERT(MbapHeaderSize + pduLength <= MaxAduSize);
+		mTxFrame[0] = msb(t.id);
+		mTxFrame[1] = lsb(t.id);
+		mTxFrame[4] = msb(pduLength + 1);
+		mTxFrame[5] = lsb(pduLength + 1);
+		mTxLength = MbapHeaderSize + pduLength;
+		t.slaveAddress = mTxFrame[6];
+		t.function = mTxFrame[MbapHeaderSize];
+	} else {
+		Q_ASSERT(pduLength + 3 <= MaxAduSize);
+		int length = pduLength + 1;
+		quint16 crc = Crc16::getValue(mTxFrame, length);
+		mTxFrame[length] = msb(crc);
+		mTxFrame[length + 1] = lsb(crc);
+		mTxLength = length + 2;
+		t.slaveAddress = mTxFrame[0];
+		t.function = mTxFrame[1];
+	}
+	t.requestLength = mTxLength;
+	mState = WaitForGap;
+	// Modbus RTU requires a pause between frames (see
+	// `SerialTransport::frameGap`). Often the pause has already passed while
+	// the previous reply was being processed. In that case the frame is sent
+	// right away. Otherwise we wait for the remainder of the pause using a
+	// timer, so the event loop keeps running. QTimer has millisecond
+	// resolution, so the remainder is rounded up.
+	qint64 gap = mTransport->frameGap();
+	qint64 idle = mBusIdleTimer.nsecsElapsed() / 1000;
+	if (idle >= gap) {
+		transmit();
+	} else {
+		mGapTimer->start(static_cast<int>((gap - idle + 999) / 1000));
+	}
+}
+
+void ModbusRtu::transmit()
+{
+	Q_ASSERT(mState == WaitForGap);
+	Transaction &t = mTransactions[mInFlight++];
+	const quint8 *pdu = mTxFrame +
+			(mFraming == ModbusTransport::MbapFraming ? MbapHeaderSize : 1);
+	// Expected length of the reply PDU
+	int replyLength = 5;
+	if (t.function == ReadHoldingRegisters || t.function == ReadInputRegisters)
+		replyLength = 2 + 2 * toUInt16(pdu[3], pdu[4]);
+	replyLength += mFraming == ModbusTransport::MbapFraming ? MbapHeaderSize : 3;
+	if (mFraming == ModbusTransport::RtuFraming) {
+		mRxLength = 0;
+		mResync = false;
+	}
+	mState = WaitForReply;
+	mTransport->send(mTxFrame, mTxLength);
+	if (mCounters != 0)
+		mCounters->transactions.fetchAndAddRelaxed(1);
+	t.roundTripTimer.start();
+	t.deadline = mClock.elapsed() +
+			responseTimeout(t.slaveAddress, mTxLength, replyLength);
+	startResponseTimer();
+}
+
+int ModbusRtu::responseTimeout(quint8 slaveAddress, int requestLength,
+							   int replyLength) const
+{
+	// Slaves on the same bus usually have a similar response time, so we use
+	// the statistics of all slaves for slaves we have not heard from yet. This
+	// makes searching for devices a lot faster.
+	const SlaveTiming &slave = mSlaveTiming[slaveAddress];
+	const SlaveTiming &timing = slave.samples > 0 ? slave : mBusTiming;
+	// Most requests to slaves that never replied are sent while searching
+	// for devices, and will time out anyway.
+	int maxTimeout = slave.samples > 0 ? mMaxTimeout :
+		qMin(mMaxTimeout, mProbeTimeout);
+	if (timing.samples == 0)
+		return maxTimeout;
+	qint64 timeout = timing.turnaround + DeviationFactor * timing.deviation +
+			(requestLength + replyLength) * characterTime();
+	// Microseconds to milliseconds (rounded up)
+	timeout = ((timeout + 999) / 1000) << slave.backoff;
+	return static_cast<int>(qBound<qint64>(qMin(mMinTimeout, maxTimeout),
+										   timeout, maxTimeout));
+}
+
+void ModbusRtu::addTurnaroundSample(SlaveTiming &timing, qint64 turnaround)
+{
+	// Smoothing as used for the retransmission timer of TCP (RFC 6298).
+	turnaround = qMax<qint64>(0, turnaround);
+	if (timing.samples == 0) {
+		timing.turnaround = turnaround;
+		timing.deviation = turnaround / 2;
+	} else {
+		timing.deviation = (3 * timing.deviation +
+							qAbs(timing.turnaround - turnaround)) / 4;
+		timing.turnaround = (7 * timing.turnaround + turnaround) / 8;
+	}
+	++timing.samples;
+	timing.backoff = 0;
+}
+
+int ModbusRtu::characterTime() const
+{
+	return mTransport->characterTime();
 }
@@ -2,20 +2,51 @@
 #define MODBUS_RTU_H
 
 #include <QByteArray>
+#include <QElapsedTimer>
 #include <QList>
-#include <QMetaType>
 #include <QObject>
-extern "C" {
-	#include <velib/platform/serial.h>
-}
+#include <QVector>
 #include "crc16.h"
+#include "defines.h"
+#include "modbus_counters.h"
+#include "modbus_transport.h"
 
 class QTimer;
 
-Q_DECLARE_METATYPE(QList<quint16>)
+/*!
+ * Read only view on the registers in a Modbus reply.
+ * The registers are decoded on access, so no copy of the reply is needed.
+ * A span refers to the receive buffer of `ModbusRtu`, so it is only valid
+ * while the `readCompleted` signal is being emitted. This also means it
+ * cannot be passed through queued connections.
+ */
+class RegisterSpan
+{
+public:
+	RegisterSpan(const quint8 *data, int count):
+		mData(data),
+		mCount(count)
+	{
+	}
+
+	int size() const
+	{
+		return mCount;
+	}
+
+	quint16 operator[](int i) const
+	{
+		Q_ASSERT(i >= 0 && i < mCount);
+		return toUInt16(mData[2 * i], mData[2 * i + 1]);
+	}
+
+private:
+	const quint8 *mData;
+	int mCount;
+};
 
 /*!
- * Partial implementation of the Modbus RTU protocol.
+ * Partial implementation of the Modbus RTU and Modbus TCP protocols.
  *
  * Supported functions: `ReadHoldingRegisters`, `ReadInputRegisters`,
  * and `WriteSingleRegister`.
@@ -23,6 +54,15 @@ Q_DECLARE_METATYPE(QList<quint16>)
  * Communication is implemented asynchronously. It is allowed to add multiple
  * request at once. They will be queued and sent to the device whenever it is
  * ready (ie. all previous requests have been handled).
+ *
+ * Each request has a priority. Pending requests with a higher priority are
+ * sent first, so a write requested by the user does not have to wait for all
+ * queued polling reads. A read request which is already queued (same slave,
+ * function, and register range) will not be queued again.
+ *
+ * The frames are exchanged through a `ModbusTransport`. If the transport
+ * allows it (Modbus TCP), multiple requests may be waiting for a reply at the
+ * same time. Replies are matched with the requests using the transaction ID.
  */
 class ModbusRtu : public QObject
 {
@@ -60,6 +100,16 @@ public:
 		GatewayTargetDeviceFailedToRespond	= 11
 	};
 
+	enum Priority {
+		/// Requests initiated by the user (eg. writes from the D-Bus)
+		ControlPriority,
+		/// Polling of values that change quickly (voltage, current, etc.)
+		TelemetryPriority,
+		/// Polling of values that change slowly (status registers, etc.)
+		StatusPriority,
+		PriorityCount
+	};
+
 	enum ErrorType {
 		CrcError,
 		Timeout,
@@ -67,23 +117,91 @@ public:
 		Unsupported
 	};
 
-	ModbusRtu(const QString &portName, int baudrate, QObject *parent = 0);
+	/*!
+	 * Response time statistics of a single slave.
+	 * The turnaround is the time between the end of a request and the start
+	 * of the reply. So it does not include the time needed to send the frames
+	 * over the bus.
+	 */
+	struct RoundTripStats {
+		/// Number of replies received from the slave
+		int samples;
+		/// Smoothed turnaround time in microseconds
+		int turnaround;
+		/// Mean deviation of the turnaround time in microseconds
+		int turnaroundDeviation;
+		/// Timeout used for the next request in milliseconds
+		int timeout;
+	};
+
+	/*!
+	 * Creates the protocol engine. Ownership of `transport` is transferred
+	 * to the new object.
+	 */
+	ModbusRtu(ModbusTransport *transport, QObject *parent = 0);
+
+	/*!
+	 * Sets the bounds of the response timeout (in milliseconds).
+	 * The actual timeout is derived from the measured turnaround time of
+	 * each slave (similar to the retransmission timeout of TCP). Until a
+	 * reply has been received from any slave, `maxTimeout` will be used.
+	 */
+	void setTimeoutBounds(int minTimeout, int maxTimeout);
+
+	int minTimeout() const;
+
+	int maxTimeout() const;
+
+	/*!
+	 * Sets the maximum timeout (in milliseconds) of requests to slaves that
+	 * have never replied. This speeds up searching for devices. If the
+	 * probe timeout is larger than `maxTimeout`, the latter is used.
+	 */
+	void setProbeTimeout(int timeout);
+
+	int probeTimeout() const;
 
-	~ModbusRtu();
+	/*!
+	 * Returns the number of requests that may be waiting for a reply at the
+	 * same time (1 unless the transport supports pipelining).
+	 */
+	int maxInFlight() const;
+
+	RoundTripStats roundTripStats(quint8 slaveAddress) const;
 
 	void readRegisters(FunctionCode function, quint8 slaveAddress,
-					   quint16 startReg, quint16 count);
+					   quint16 startReg, quint16 count,
+					   Priority priority = TelemetryPriority);
 
 	void writeRegister(FunctionCode function, quint8 slaveAddress,
-					   quint16 reg, quint16 value);
+					   quint16 reg, quint16 value,
+					   Priority priority = ControlPriority);
+
+	/*!
+	 * Returns the number of requests waiting to be sent.
+	 */
+	int pendingCount() const;
+
+	/*!
+	 * Sets the object used to collect performance counters. The counters are
+	 * not owned by this object. May be 0 (the default), which disables
+	 * collection.
+	 */
+	void setCounters(ModbusCounters *counters);
+
+	ModbusCounters *counters() const;
 
 signals:
-	void readCompleted(int function, quint8 slaveAddress, const QList<quint16> &values);
+	void readCompleted(int function, quint8 slaveAddress, const RegisterSpan &values);
 
 	void writeCompleted(int function, quint8 slaveAddress, quint16 address, quint16 value);
 
 	void errorReceived(int errorType, quint8 slaveAddress, int exception);
 
+	/*!
+	 * Emitted when the transport reports an error (eg. the serial port has
+	 * been disconnected).
+	 */
 	void serialEvent(const char *description);
 
 private slots:
@@ -91,61 +209,155 @@ private slots:
 
 	void processPacket();
 
+	void transmit();
+
+	void onDataReceived(const quint8 *data, int length);
+
 private:
-	void handleByteRead(quint8 b);
+	void parseFrames();
+
+	/*!
+	 * Returns the length of the RTU reply frame at the start of the receive
+	 * buffer, 0 if more data is needed to determine the length, or -1 if the
+	 * buffer does not start with a valid reply.
+	 */
+	int replyLength() const;
+
+	/*!
+	 * Same as `replyLength` for Modbus TCP. `transaction` is set to the
+	 * index of the matching transaction, or -1 if the reply does not belong
+	 * to any pending request.
+	 */
+	int mbapReplyLength(int &transaction) const;
+
+	void dropBytes(int count);
+
+	void removeTransaction(int index);
 
 	void resetStateEngine();
 
+	void startResponseTimer();
+
+	bool canSend() const;
+
 	void processPending();
 
+	/*!
+	 * Sends the next request from the queues. Returns false if all queues are
+	 * empty.
+	 */
+	bool sendPending();
+
+	void enqueue(FunctionCode function, quint8 slaveAddress, quint16 reg,
+				 quint16 value, Priority priority);
+
 	void _readRegisters(FunctionCode function, quint8 slaveAddress,
 						quint16 startReg, quint16 count);
 
 	void _writeRegister(FunctionCode function, quint8 slaveAddress,
 						quint16 reg, quint16 value);
 
-	void send(QByteArray &data);
+	/*!
+	 * Writes the header of a new frame for `slaveAddress` to the transmit
+	 * buffer, and returns a pointer to the location of the PDU.
+	 */
+	quint8 *beginFrame(quint8 slaveAddress);
+
+	void send(int pduLength);
+
+	struct SlaveTiming {
+		int samples;
+		qint64 turnaround;
+		qint64 deviation;
+		int backoff;
+	};
 
-	static void onDataRead(struct VeSerialPortS *port, const quint8 *buffer,
-						   quint32 length);
+	/*!
+	 * Returns the timeout for a request of `requestLength` bytes to
+	 * `slaveAddress` with a reply of `replyLength` bytes.
+	 */
+	int responseTimeout(quint8 slaveAddress, int requestLength,
+						int replyLength) const;
 
-	static void onSerialEvent(struct VeSerialPortS *port, VeSerialEvent event,
-							  char const *desc);
+	void addTurnaroundSample(SlaveTiming &timing, qint64 turnaround);
+
+	int characterTime() const;
+
+	enum {
+		// Maximum size of a Modbus frame (MBAP header and 253 bytes PDU)
+		MaxAduSize = 260,
+		MbapHeaderSize = 7,
+		MaxInFlight = 4,
+		// Large enough to hold the replies to all pending requests
+		RxBufferSize = MaxInFlight * MaxAduSize
+	};
 
 	enum ReadState {
 		Idle,
-		Address,
-		Function,
-		ByteCount,
-		StartAddressMsb,
-		StartAddressLsb,
-		Data,
-		CrcMsb,
-		CrcLsb,
+		WaitForGap,
+		// At least one request is waiting for a reply. More requests may be
+		// sent if the transport allows it.
+		WaitForReply,
 		Process
 	};
 
-	VeSerialPort mSerialPort;
-	QByteArray mPortName;
+	ModbusTransport *mTransport;
+	ModbusTransport::Framing mFraming;
+	int mMaxInFlight;
 	QTimer *mTimer;
+	QTimer *mGapTimer;
+	// Time since the last frame on the bus has been completed
+	QElapsedTimer mBusIdleTimer;
+	// Frame being sent. Requests are built in place, so no memory has to be
+	// allocated while polling.
+	quint8 mTxFrame[MaxAduSize];
+	int mTxLength;
+	quint16 mNextTransactionId;
+	// Requests waiting for a reply, in order of transmission
+	struct Transaction {
+		quint16 id;
+		quint8 slaveAddress;
+		quint8 function;
+		int requestLength;
+		// Expiry time of the request (in ms, relative to `mClock`)
+		qint64 deadline;
+		// Measures the time between transmission of a request and the reply
+		QElapsedTimer roundTripTimer;
+	};
+	Transaction mTransactions[MaxInFlight];
+	int mInFlight;
+	// Transaction of the reply at the start of `mRxFrame` (`Process` state)
+	int mCurrentTransaction;
+	QElapsedTimer mClock;
+	int mMinTimeout;
+	int mMaxTimeout;
+	int mProbeTimeout;
+	// Response time statistics per slave address, and for all slaves together.
+	SlaveTiming mSlaveTiming[256];
+	SlaveTiming mBusTiming;
 	struct Cmd {
 		ModbusRtu::FunctionCode function;
 		quint8 slaveAddress;
 		quint16 reg;
 		quint16 value;
 	};
-	QList<Cmd> mPendingCommands;
-	uint8_t mCurrentSlave;
+	// Pending requests, one queue per priority
+	QVector<Cmd> mPendingCommands[PriorityCount];
+	// Number of telemetry requests sent since the last status request
+	int mTelemetryBurst;
+	ModbusCounters *mCounters;
 
 	// State engine
 	ReadState mState;
-	FunctionCode mFunction;
-	uint8_t mCount;
-	quint16 mStartAddress;
-	quint16 mCrc;
-	Crc16 mCrcBuilder;
-	bool mAddToCrc;
-	QByteArray mData;
+	// Reply being received. The reply may be preceded by garbage, which will
+	// be removed while parsing. With Modbus TCP more replies may follow.
+	quint8 mRxFrame[RxBufferSize];
+	int mRxLength;
+	// Length of the reply at the start of `mRxFrame` once it is complete
+	int mFrameLength;
+	bool mCrcValid;
+	// True if bytes have been dropped while searching for the reply
+	bool mResync;
 };
 
 #endif // MODBUS_RTU_H
@@ -0,0 +1,21 @@
+#include "modbus_transport.h"
+
+ModbusTransport::ModbusTransport(QObject *parent):
+	QObject(parent)
+{
+}
+
+int ModbusTransport::maxInFlight() const
+{
+	return 1;
+}
+
+int ModbusTransport::frameGap() const
+{
+	return 0;
+}
+
+int ModbusTransport::characterTime() const
+{
+	return 0;
+}
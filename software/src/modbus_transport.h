@@ -0,0 +1,58 @@
+#ifndef MODBUS_TRANSPORT_H
+#define MODBUS_TRANSPORT_H
+
+#include <QObject>
+
+/*!
+ * Connection used by `ModbusRtu` to exchange frames with the slaves.
+ * The transport only moves bytes. Building and parsing of the frames is done
+ * by `ModbusRtu`, using the framing reported by the transport.
+ */
+class ModbusTransport : public QObject
+{
+	Q_OBJECT
+public:
+	enum Framing {
+		/// Slave address, PDU, and CRC (Modbus RTU, also used for RTU over TCP)
+		RtuFraming,
+		/// MBAP header and PDU without CRC (Modbus TCP)
+		MbapFraming
+	};
+
+	ModbusTransport(QObject *parent = 0);
+
+	virtual Framing framing() const = 0;
+
+	/*!
+	 * Returns the number of requests which may wait for a reply at the same
+	 * time. The default is 1.
+	 */
+	virtual int maxInFlight() const;
+
+	/*!
+	 * Returns the minimum silent interval between 2 frames in microseconds.
+	 * The default is 0.
+	 */
+	virtual int frameGap() const;
+
+	/*!
+	 * Returns the time needed to transfer a single byte in microseconds.
+	 * Used to separate the response time of a slave from the time needed to
+	 * transfer the frames. The default is 0.
+	 */
+	virtual int characterTime() const;
+
+	virtual void send(const quint8 *data, int length) = 0;
+
+signals:
+	/*!
+	 * Emitted when data has been received. This signal may be emitted from
+	 * another thread, and `data` is only valid during emission, so it should
+	 * be connected using `Qt::DirectConnection`.
+	 */
+	void dataReceived(const quint8 *data, int length);
+
+	void transportError(const char *description);
+};
+
+#endif // MODBUS_TRANSPORT_H
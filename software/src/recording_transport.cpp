@@ -0,0 +1,100 @@
+#include <string.h>
+#include <QMutexLocker>
+#include <QsLog.h>
+#include "recording_transport.h"
+
+const char RecordingTransport::Magic[4] = { 'R', 'F', 'T', 'R' };
+
+static void putUInt16(quint8 *p, quint16 v)
+{
+	p[0] = v & 0xFF;
+	p[1] = v >> 8;
+}
+
+static void putUInt32(quint8 *p, quint32 v)
+{
+	putUInt16(p, v & 0xFFFF);
+	putUInt16(p + 2, v >> 16);
+}
+
+RecordingTransport::RecordingTransport(ModbusTransport *transport,
+									   const QString &fileName,
+									   QObject *parent):
+	ModbusTransport(parent),
+	mTransport(transport),
+	mFile(fileName),
+	mLastRecord(0)
+{
+	mTransport->setParent(this);
+	connect(mTransport, SIGNAL(dataReceived(const quint8 *, int)),
+			this, SLOT(onDataReceived(const quint8 *, int)),
+			Qt::DirectConnection);
+	connect(mTransport, SIGNAL(transportError(const char *)),
+			this, SIGNAL(transportError(const char *)),
+			Qt::DirectConnection);
+	if (!mFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		QLOG_ERROR() << "Could not create recording" << fileName << ':'
+					 << mFile.errorString();
+		return;
+	}
+	QLOG_INFO() << "Recording traffic to" << fileName;
+	quint8 header[HeaderSize];
+	memcpy(header, Magic, sizeof(Magic));
+	header[4] = FormatVersion;
+	header[5] = mTransport->framing();
+	header[6] = mTransport->maxInFlight();
+	putUInt32(header + 7, mTransport->characterTime());
+	putUInt32(header + 11, mTransport->frameGap());
+	mFile.write(reinterpret_cast<const char *>(header), sizeof(header));
+	mTimer.start();
+}
+
+ModbusTransport::Framing RecordingTransport::framing() const
+{
+	return mTransport->framing();
+}
+
+int RecordingTransport::maxInFlight() const
+{
+	return mTransport->maxInFlight();
+}
+
+int RecordingTransport::frameGap() const
+{
+	return mTransport->frameGap();
+}
+
+int RecordingTransport::characterTime() const
+{
+	return mTransport->characterTime();
+}
+
+void RecordingTransport::send(const quint8 *data, int length)
+{
+	writeRecord(Transmit, data, length);
+	mTransport->send(data, length);
+}
+
+void RecordingTransport::onDataReceived(const quint8 *data, int length)
+{
+	writeRecord(Receive, data, length);
+	emit dataReceived(data, length);
+}
+
+void RecordingTransport::writeRecord(Direction direction, const quint8 *data,
+									 int length)
+{
+	QMutexLocker locker(&mMutex);
+	if (!mFile.isOpen())
+		return;
+	qint64 now = mTimer.nsecsElapsed() / 1000;
+	quint8 header[RecordHeaderSize];
+	header[0] = direction;
+	putUInt32(header + 1, static_cast<quint32>(now - mLastRecord));
+	putUInt16(header + 5, length);
+	mLastRecord = now;
+	mFile.write(reinterpret_cast<const char *>(header), sizeof(header));
+	mFile.write(reinterpret_cast<const char *>(data), length);
+	// Make sure the recording is complete when the process is killed.
+	mFile.flush();
+}
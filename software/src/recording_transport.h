@@ -0,0 +1,73 @@
+#ifndef RECORDING_TRANSPORT_H
+#define RECORDING_TRANSPORT_H
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include "modbus_transport.h"
+
+/*!
+ * Passes all traffic to another transport, and writes a copy of it to a file.
+ * The recording can be played back with `ReplayTransport`.
+ *
+ * File format (all numbers are little endian):
+ * - Header: the magic 'RFTR', format version (1 byte), framing (1 byte),
+ *   maximum number of requests in flight (1 byte), character time and frame
+ *   gap (microseconds, 4 bytes each).
+ * - One record per frame sent or chunk of data received: direction (1 byte,
+ *   see `Direction`), time since the previous record (microseconds, 4 bytes),
+ *   length (2 bytes), and the data.
+ *
+ * Received data is recorded as it is reported by the transport, so a reply may
+ * be split over several records.
+ */
+class RecordingTransport : public ModbusTransport
+{
+	Q_OBJECT
+public:
+	enum Direction {
+		Transmit = 0,
+		Receive = 1
+	};
+
+	enum {
+		FormatVersion = 1,
+		HeaderSize = 15,
+		RecordHeaderSize = 7
+	};
+
+	static const char Magic[4];
+
+	/*!
+	 * Creates the recorder. Ownership of `transport` is transferred to the
+	 * new object. If the file cannot be created, nothing will be recorded.
+	 */
+	RecordingTransport(ModbusTransport *transport, const QString &fileName,
+					   QObject *parent = 0);
+
+	virtual Framing framing() const;
+
+	virtual int maxInFlight() const;
+
+	virtual int frameGap() const;
+
+	virtual int characterTime() const;
+
+	virtual void send(const quint8 *data, int length);
+
+private slots:
+	void onDataReceived(const quint8 *data, int length);
+
+private:
+	void writeRecord(Direction direction, const quint8 *data, int length);
+
+	ModbusTransport *mTransport;
+	// Data is received in the reader thread of the serial port, so access to
+	// the file and the timer must be serialized.
+	QMutex mMutex;
+	QFile mFile;
+	QElapsedTimer mTimer;
+	qint64 mLastRecord;
+};
+
+#endif // RECORDING_TRANSPORT_H
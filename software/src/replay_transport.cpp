@@ -0,0 +1,173 @@
+#include <string.h>
+#include <QCoreApplication>
+#include <QFile>
+#include <QsLog.h>
+#include <QTimer>
+#include "recording_transport.h"
+#include "replay_transport.h"
+
+static quint16 getUInt16(const char *p)
+{
+	return static_cast<quint8>(p[0]) | (static_cast<quint8>(p[1]) << 8);
+}
+
+static quint32 getUInt32(const char *p)
+{
+	return getUInt16(p) | (static_cast<quint32>(getUInt16(p + 2)) << 16);
+}
+
+ReplayTransport::ReplayTransport(const QString &fileName, Speed speed,
+								 QObject *parent):
+	ModbusTransport(parent),
+	mSpeed(speed),
+	mFraming(RtuFraming),
+	mMaxInFlight(1),
+	mCharacterTime(0),
+	mFrameGap(0),
+	mIndex(0),
+	mRequestTime(0),
+	mReplyTimer(new QTimer(this)),
+	mMismatches(0),
+	mFinished(false)
+{
+	mReplyTimer->setSingleShot(true);
+	connect(mReplyTimer, SIGNAL(timeout()), this, SLOT(onReplyTimer()));
+	if (!load(fileName)) {
+		finish();
+		return;
+	}
+	QLOG_INFO() << "Replaying" << mRecords.size() << "records from" << fileName;
+	mReplayTimer.start();
+}
+
+ModbusTransport::Framing ReplayTransport::framing() const
+{
+	return mFraming;
+}
+
+int ReplayTransport::maxInFlight() const
+{
+	return mMaxInFlight;
+}
+
+int ReplayTransport::frameGap() const
+{
+	// There is no bus, so there's no need to wait between frames.
+	return mSpeed == RealTime ? mFrameGap : 0;
+}
+
+int ReplayTransport::characterTime() const
+{
+	return mCharacterTime;
+}
+
+void ReplayTransport::send(const quint8 *data, int length)
+{
+	if (mFinished)
+		return;
+	// Data received after the previous request which has not been played
+	// back yet is skipped.
+	mReplyTimer->stop();
+	while (mIndex < mRecords.size() && !mRecords[mIndex].transmit)
+		++mIndex;
+	if (mIndex == mRecords.size()) {
+		finish();
+		return;
+	}
+	const Record &r = mRecords[mIndex];
+	// The transaction ID of Modbus TCP requests is not compared, because it
+	// depends on the number of requests sent since startup.
+	int skip = mFraming == MbapFraming ? 2 : 0;
+	if (r.length != length ||
+		memcmp(mData.constData() + r.offset + skip, data + skip,
+			   length - skip) != 0) {
+		++mMismatches;
+		QLOG_DEBUG() << "Request does not match recording at record" << mIndex;
+	}
+	mRequestTime = r.time;
+	mRequestTimer.start();
+	++mIndex;
+	scheduleReply();
+}
+
+void ReplayTransport::onReplyTimer()
+{
+	if (mIndex >= mRecords.size() || mRecords[mIndex].transmit)
+		return;
+	const Record &r = mRecords[mIndex++];
+	emit dataReceived(reinterpret_cast<const quint8 *>(mData.constData()) +
+					  r.offset, r.length);
+	scheduleReply();
+}
+
+bool ReplayTransport::load(const QString &fileName)
+{
+	QFile file(fileName);
+	if (!file.open(QIODevice::ReadOnly)) {
+		QLOG_ERROR() << "Could not open recording" << fileName << ':'
+					 << file.errorString();
+		return false;
+	}
+	mData = file.readAll();
+	const char *d = mData.constData();
+	if (mData.size() < RecordingTransport::HeaderSize ||
+		memcmp(d, RecordingTransport::Magic, 4) != 0 ||
+		d[4] != RecordingTransport::FormatVersion) {
+		QLOG_ERROR() << fileName << "is not a valid recording";
+		return false;
+	}
+	mFraming = d[5] == MbapFraming ? MbapFraming : RtuFraming;
+	mMaxInFlight = d[6];
+	mCharacterTime = getUInt32(d + 7);
+	mFrameGap = getUInt32(d + 11);
+	int offset = RecordingTransport::HeaderSize;
+	qint64 time = 0;
+	while (offset + RecordingTransport::RecordHeaderSize <= mData.size()) {
+		Record r;
+		r.transmit = d[offset] == RecordingTransport::Transmit;
+		time += getUInt32(d + offset + 1);
+		r.time = time;
+		r.length = getUInt16(d + offset + 5);
+		r.offset = offset + RecordingTransport::RecordHeaderSize;
+		if (r.offset + r.length > mData.size())
+			break; // Truncated recording
+		mRecords.append(r);
+		offset = r.offset + r.length;
+	}
+	return true;
+}
+
+void ReplayTransport::scheduleReply()
+{
+	if (mIndex == mRecords.size()) {
+		finish();
+		return;
+	}
+	const Record &r = mRecords[mIndex];
+	if (r.transmit)
+		return;
+	// Data is never delivered from within `send`, because `ModbusRtu` does
+	// not expect a reply before the request has been sent.
+	qint64 delay = 0;
+	if (mSpeed == RealTime) {
+		delay = (r.time - mRequestTime) / 1000 - mRequestTimer.elapsed();
+		delay = qMax<qint64>(0, delay);
+	}
+	mReplyTimer->start(static_cast<int>(delay));
+}
+
+void ReplayTransport::finish()
+{
+	if (mFinished)
+		return;
+	mFinished = true;
+	if (mReplayTimer.isValid()) {
+		QLOG_INFO() << "Replay finished:" << mRecords.size() << "records in"
+					<< mReplayTimer.elapsed() << "ms," << mMismatches
+					<< "requests did not match the recording";
+	}
+	// This object lives in the thread of the bus worker, so the application
+	// is stopped using a queued call.
+	QMetaObject::invokeMethod(QCoreApplication::instance(), "quit",
+							  Qt::QueuedConnection);
+}
@@ -0,0 +1,80 @@
+#ifndef REPLAY_TRANSPORT_H
+#define REPLAY_TRANSPORT_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QVector>
+#include "modbus_transport.h"
+
+class QTimer;
+
+/*!
+ * Plays back traffic recorded by `RecordingTransport`, so a session can be
+ * reproduced without any hardware.
+ *
+ * Playback is driven by the requests: each request sent is matched with the
+ * next request in the recording, and the data received after that request
+ * is fed back to `ModbusRtu`. With `RealTime` the data is delivered with the
+ * delays found in the recording, with `AsFastAsPossible` right away. A
+ * request without reply in the recording will time out as usual.
+ *
+ * The application is stopped when the end of the recording has been reached.
+ */
+class ReplayTransport : public ModbusTransport
+{
+	Q_OBJECT
+public:
+	enum Speed {
+		RealTime,
+		AsFastAsPossible
+	};
+
+	ReplayTransport(const QString &fileName, Speed speed, QObject *parent = 0);
+
+	virtual Framing framing() const;
+
+	virtual int maxInFlight() const;
+
+	virtual int frameGap() const;
+
+	virtual int characterTime() const;
+
+	virtual void send(const quint8 *data, int length);
+
+private slots:
+	void onReplyTimer();
+
+private:
+	bool load(const QString &fileName);
+
+	void scheduleReply();
+
+	void finish();
+
+	struct Record {
+		bool transmit;
+		// Time since the start of the recording in microseconds
+		qint64 time;
+		int offset;
+		int length;
+	};
+
+	Speed mSpeed;
+	Framing mFraming;
+	int mMaxInFlight;
+	int mCharacterTime;
+	int mFrameGap;
+	QByteArray mData;
+	QVector<Record> mRecords;
+	// Index of the next record to be played back
+	int mIndex;
+	// Time of the last request in the recording, and when it was replayed
+	qint64 mRequestTime;
+	QElapsedTimer mRequestTimer;
+	QTimer *mReplyTimer;
+	int mMismatches;
+	QElapsedTimer mReplayTimer;
+	bool mFinished;
+};
+
+#endif // REPLAY_TRANSPORT_H
@@ -0,0 +1,148 @@
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <QSocketNotifier>
+#include <QVector>
+#include "batteryController.h"
+#include "sample_trace.h"
+
+SampleTrace *SampleTrace::mInstance = 0;
+int SampleTrace::mSignalFds[2] = { -1, -1 };
+
+SampleTrace::SampleTrace(QObject *parent):
+	QObject(parent),
+	mCount(0),
+	mSignalNotifier(0)
+{
+	Q_ASSERT(mInstance == 0);
+	mClock.start();
+	mInstance = this;
+	// Only async-signal-safe functions may be used in a signal handler, so
+	// the handler writes to a socket, which is watched by the event loop.
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, mSignalFds) == 0) {
+		mSignalNotifier = new QSocketNotifier(mSignalFds[1],
+											  QSocketNotifier::Read, this);
+		connect(mSignalNotifier, SIGNAL(activated(int)), this, SLOT(onSignal()));
+		struct sigaction action;
+		action.sa_handler = signalHandler;
+		sigemptyset(&action.sa_mask);
+		action.sa_flags = SA_RESTART;
+		sigaction(SIGUSR1, &action, 0);
+	}
+}
+
+SampleTrace::~SampleTrace()
+{
+	if (mSignalNotifier != 0) {
+		signal(SIGUSR1, SIG_DFL);
+		close(mSignalFds[0]);
+		close(mSignalFds[1]);
+		mSignalFds[0] = -1;
+		mSignalFds[1] = -1;
+	}
+	mInstance = 0;
+}
+
+void SampleTrace::add(int slaveAddress, int parameter, int value)
+{
+	SampleTrace *trace = mInstance;
+	if (trace == 0)
+		return;
+	quint32 index = static_cast<quint32>(trace->mCount.fetchAndAddRelaxed(1));
+	Sample &s = trace->mSamples[index % Capacity];
+	s.time = static_cast<quint32>(trace->mClock.elapsed());
+	s.slaveAddress = slaveAddress;
+	s.parameter = parameter;
+	s.value = value;
+	trace->mSequences[index % Capacity].fetchAndStoreRelease(
+			static_cast<int>(index + 1));
+}
+
+const char *SampleTrace::parameterName(int parameter)
+{
+	switch (parameter) {
+	case BattVolts: return "BattVolts";
+	case BussVolts: return "BussVolts";
+	case BattAmps: return "BattAmps";
+	case BussAmps: return "BussAmps";
+	case BattTemp: return "BattTemp";
+	case AirTemp: return "AirTemp";
+	case SOC: return "SOC";
+	case SOC_AmpHrs: return "SOC_AmpHrs";
+	case StsRegWarning: return "StsRegWarning";
+	case StsRegSummary: return "StsRegSummary";
+	case StsRegHardwareFailure: return "StsRegHardwareFailure";
+	case StsRegOperationalFailure: return "StsRegOperationalFailure";
+	case StsRegOperationalMode: return "StsRegOperationalMode";
+	case HealthIndication: return "HealthIndication";
+	case ZBMState: return "ZBMState";
+	case DeviceAddress: return "DeviceAddress";
+	case ClearStatusRegisterFlags: return "ClearStatusRegisterFlags";
+	case EnableSelfMaintenanceAtTheEndOfDischarge:
+		return "EnableSelfMaintenanceAtTheEndOfDischarge";
+	case EnterRunCommand: return "EnterRunCommand";
+	case SelfDischargeAndMaintenanceCycle:
+		return "SelfDischargeAndMaintenanceCycle";
+	default: return "Unknown";
+	}
+}
+
+int SampleTrace::dumpRequest() const
+{
+	return 0;
+}
+
+void SampleTrace::setDumpRequest(int r)
+{
+	if (r == 0)
+		return;
+	dump();
+	// Reset the value on the D-Bus, so the next request is seen as a change.
+	emit dumpRequestChanged();
+}
+
+void SampleTrace::dump()
+{
+	// Copy the samples first, so the log is not written from a buffer that
+	// is being modified. Samples which have not been written completely are
+	// skipped.
+	quint32 end = static_cast<quint32>(mCount.fetchAndAddOrdered(0));
+	quint32 count = qMin<quint32>(end, Capacity);
+	QVector<Sample> samples;
+	QVector<quint32> indices;
+	samples.reserve(count);
+	indices.reserve(count);
+	for (quint32 i=end - count; i!=end; ++i) {
+		int sequence = mSequences[i % Capacity].fetchAndAddAcquire(0);
+		if (static_cast<quint32>(sequence) != i + 1)
+			continue;
+		samples.append(mSamples[i % Capacity]);
+		indices.append(i);
+	}
+	// Samples added while copying may have overwritten the oldest samples.
+	quint32 newEnd = static_cast<quint32>(mCount.fetchAndAddOrdered(0));
+	int first = 0;
+	while (first < indices.size() && newEnd - indices[first] > Capacity)
+		++first;
+	samples.remove(0, first);
+	QLOG_INFO() << "Dumping" << samples.size() << "samples";
+	foreach (const Sample &s, samples) {
+		QLOG_INFO() << s.time << "ms" << parameterName(s.parameter) << s.value
+					<< '@' << static_cast<int>(s.slaveAddress);
+	}
+	QLOG_INFO() << "End of dump";
+}
+
+void SampleTrace::onSignal()
+{
+	char c;
+	if (read(mSignalFds[1], &c, 1) == 1)
+		dump();
+}
+
+void SampleTrace::signalHandler(int)
+{
+	char c = 1;
+	ssize_t r = write(mSignalFds[0], &c, 1);
+	Q_UNUSED(r);
+}
@@ -0,0 +1,102 @@
+#ifndef SAMPLE_TRACE_H
+#define SAMPLE_TRACE_H
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QsLog.h>
+
+class QSocketNotifier;
+
+/*!
+ * Records a value retrieved from a battery. The value is always stored in
+ * the `SampleTrace` ring buffer, which takes a few instructions. It is only
+ * formatted and written to the log when the log level is `TraceLevel`.
+ */
+#define TRACE_SAMPLE(slaveAddress, parameter, value) \
+	do { \
+		SampleTrace::add((slaveAddress), (parameter), (value)); \
+		QLOG_TRACE() << SampleTrace::parameterName(parameter) << (value) \
+					 << '@' << (slaveAddress); \
+	} while (0)
+
+/*!
+ * Ring buffer containing the most recent values retrieved from the
+ * batteries, in binary form.
+ * The contents of the buffer are written to the log when the process receives
+ * SIGUSR1, or when `dumpRequest` is set (eg. from the D-Bus by `DebugBridge`).
+ * This replaces continuous logging of all values, which costs CPU time and
+ * wears the flash storage.
+ *
+ * A single instance should be created in the main thread before the bus
+ * workers are started. Samples may be added from any thread. Adding a sample
+ * does not take a lock: each writer reserves a slot by incrementing the
+ * sample count atomically.
+ */
+class SampleTrace : public QObject
+{
+	Q_OBJECT
+	Q_PROPERTY(int dumpRequest READ dumpRequest WRITE setDumpRequest NOTIFY dumpRequestChanged)
+public:
+	explicit SampleTrace(QObject *parent = 0);
+
+	~SampleTrace();
+
+	/*!
+	 * Adds a sample to the buffer of the current instance (if any). The
+	 * oldest sample is overwritten when the buffer is full.
+	 */
+	static void add(int slaveAddress, int parameter, int value);
+
+	static const char *parameterName(int parameter);
+
+	/*!
+	 * Always 0. Setting it to a non-zero value dumps the buffer to the log.
+	 */
+	int dumpRequest() const;
+
+	void setDumpRequest(int r);
+
+public slots:
+	/*!
+	 * Writes all samples in the buffer to the log, oldest first.
+	 */
+	void dump();
+
+signals:
+	void dumpRequestChanged();
+
+private slots:
+	void onSignal();
+
+private:
+	static void signalHandler(int signal);
+
+	enum {
+		Capacity = 4096
+	};
+
+	struct Sample {
+		// Milliseconds since creation of the trace
+		quint32 time;
+		quint8 slaveAddress;
+		quint8 parameter;
+		qint32 value;
+	};
+
+	static SampleTrace *mInstance;
+	// Socket pair used to pass SIGUSR1 to the event loop
+	static int mSignalFds[2];
+
+	QElapsedTimer mClock;
+	Sample mSamples[Capacity];
+	// Number of the sample stored in each slot plus one, set after the sample
+	// has been written. Used by `dump` to skip samples still being written.
+	QAtomicInt mSequences[Capacity];
+	// Total number of samples added (as unsigned value). The newest sample is
+	// stored at (mCount - 1) % Capacity.
+	QAtomicInt mCount;
+	QSocketNotifier *mSignalNotifier;
+};
+
+#endif // SAMPLE_TRACE_H
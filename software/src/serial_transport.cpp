@@ -0,0 +1,68 @@
+#include <string.h>
+#include <QsLog.h>
+#include "serial_transport.h"
+
+SerialTransport::SerialTransport(const QString &portName, int baudrate,
+								 QObject *parent):
+	ModbusTransport(parent),
+	mPortName(portName.toLatin1())
+{
+	memset(&mSerialPort, 0, sizeof(mSerialPort));
+	// The pointer returned by mPortName.data() will remain valid as long as
+	// mPortName exists and is not changed.
+	mSerialPort.dev = mPortName.data();
+	mSerialPort.baudrate = baudrate;
+	mSerialPort.intLevel = 2;
+	mSerialPort.rxCallback = onDataRead;
+	mSerialPort.eventCallback = onSerialEvent;
+	veSerialOpen(&mSerialPort, this);
+}
+
+SerialTransport::~SerialTransport()
+{
+	veSerialClose(&mSerialPort);
+}
+
+ModbusTransport::Framing SerialTransport::framing() const
+{
+	return RtuFraming;
+}
+
+int SerialTransport::frameGap() const
+{
+	// Modbus requires a pause between frames of 3.5 times the interval needed
+	// to send a character. We use 4 characters here, just in case...
+	return 4 * characterTime();
+}
+
+int SerialTransport::characterTime() const
+{
+	// We assume 10 bits per caracter (8 data bits, 1 stop bit and 1 parity
+	// bit). Keep in mind that overestimating the charcter time does not hurt
+	// (a lot), but underestimating does.
+	// Then number of bits devided by the the baudrate (unit: bits/second) gives
+	// us the time in seconds. We want the time in microseconds, so we have to
+	// multiply by 1 million.
+	return (10 * 1000 * 1000) / mSerialPort.baudrate;
+}
+
+void SerialTransport::send(const quint8 *data, int length)
+{
+	veSerialPutBuf(&mSerialPort, const_cast<quint8 *>(data), length);
+}
+
+void SerialTransport::onDataRead(VeSerialPortS *port, const quint8 *buffer,
+								 quint32 length)
+{
+	SerialTransport *transport = reinterpret_cast<SerialTransport *>(port->ctx);
+	emit transport->dataReceived(buffer, static_cast<int>(length));
+}
+
+void SerialTransport::onSerialEvent(VeSerialPortS *port, VeSerialEvent event,
+									const char *desc)
+{
+	QLOG_INFO() << "onSerialEvent";
+	Q_UNUSED(event);
+	SerialTransport *transport = reinterpret_cast<SerialTransport *>(port->ctx);
+	emit transport->transportError(desc);
+}
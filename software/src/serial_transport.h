@@ -0,0 +1,41 @@
+#ifndef SERIAL_TRANSPORT_H
+#define SERIAL_TRANSPORT_H
+
+#include <QByteArray>
+extern "C" {
+	#include <velib/platform/serial.h>
+}
+#include "modbus_transport.h"
+
+/*!
+ * Modbus RTU over a serial port (usually RS-485).
+ * Received data is reported from the reader thread of velib.
+ */
+class SerialTransport : public ModbusTransport
+{
+	Q_OBJECT
+public:
+	SerialTransport(const QString &portName, int baudrate, QObject *parent = 0);
+
+	~SerialTransport();
+
+	virtual Framing framing() const;
+
+	virtual int frameGap() const;
+
+	virtual int characterTime() const;
+
+	virtual void send(const quint8 *data, int length);
+
+private:
+	static void onDataRead(struct VeSerialPortS *port, const quint8 *buffer,
+						   quint32 length);
+
+	static void onSerialEvent(struct VeSerialPortS *port, VeSerialEvent event,
+							  char const *desc);
+
+	VeSerialPort mSerialPort;
+	QByteArray mPortName;
+};
+
+#endif // SERIAL_TRANSPORT_H
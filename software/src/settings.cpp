@@ -1,7 +1,15 @@
 #include "settings.h"
 
 Settings::Settings(QObject *parent) :
-	QObject(parent)
+	QObject(parent),
+	mCurrentDeadband(0),
+	mVoltageDeadband(0),
+	mPowerDeadband(0),
+	mRelativeDeadband(0),
+	mPublishMinInterval(0),
+	mPublishMaxStaleness(0),
+	mTelemetryInterval(1000),
+	mStatusInterval(30000)
 {
 }
 
@@ -25,3 +33,155 @@ void Settings::registerDevice(const QString &serial)
 	mDeviceIds.append(serial);
 	emit deviceIdsChanged();
 }
+
+const QStringList &Settings::knownDevices() const
+{
+	return mKnownDevices;
+}
+
+void Settings::setKnownDevices(const QStringList &devices)
+{
+	if (mKnownDevices == devices)
+		return;
+	mKnownDevices = devices;
+	emit knownDevicesChanged();
+}
+
+void Settings::registerAddress(const QString &portName, int address,
+							   const QString &serial)
+{
+	QString location = QString("%1:%2").arg(portName).arg(address);
+	QString entry = QString("%1=%2").arg(location).arg(serial);
+	if (mKnownDevices.contains(entry))
+		return;
+	QStringList devices;
+	foreach (const QString &d, mKnownDevices) {
+		int i = d.lastIndexOf('=');
+		if (d.left(i) != location && d.mid(i + 1) != serial)
+			devices.append(d);
+	}
+	devices.append(entry);
+	setKnownDevices(devices);
+}
+
+QList<int> Settings::knownAddresses(const QString &portName) const
+{
+	QList<int> addresses;
+	foreach (const QString &d, mKnownDevices) {
+		// The port name may contain colons (eg. tcp://host:502), so the
+		// address follows the last one.
+		QString location = d.left(d.lastIndexOf('='));
+		int i = location.lastIndexOf(':');
+		if (i < 0 || location.left(i) != portName)
+			continue;
+		bool ok = false;
+		int address = location.mid(i + 1).toInt(&ok);
+		if (ok && !addresses.contains(address))
+			addresses.append(address);
+	}
+	return addresses;
+}
+
+double Settings::currentDeadband() const
+{
+	return mCurrentDeadband;
+}
+
+void Settings::setCurrentDeadband(double v)
+{
+	if (mCurrentDeadband == v)
+		return;
+	mCurrentDeadband = v;
+	emit publishPolicyChanged();
+}
+
+double Settings::voltageDeadband() const
+{
+	return mVoltageDeadband;
+}
+
+void Settings::setVoltageDeadband(double v)
+{
+	if (mVoltageDeadband == v)
+		return;
+	mVoltageDeadband = v;
+	emit publishPolicyChanged();
+}
+
+double Settings::powerDeadband() const
+{
+	return mPowerDeadband;
+}
+
+void Settings::setPowerDeadband(double v)
+{
+	if (mPowerDeadband == v)
+		return;
+	mPowerDeadband = v;
+	emit publishPolicyChanged();
+}
+
+double Settings::relativeDeadband() const
+{
+	return mRelativeDeadband;
+}
+
+void Settings::setRelativeDeadband(double v)
+{
+	if (mRelativeDeadband == v)
+		return;
+	mRelativeDeadband = v;
+	emit publishPolicyChanged();
+}
+
+int Settings::publishMinInterval() const
+{
+	return mPublishMinInterval;
+}
+
+void Settings::setPublishMinInterval(int v)
+{
+	if (mPublishMinInterval == v)
+		return;
+	mPublishMinInterval = v;
+	emit publishPolicyChanged();
+}
+
+int Settings::publishMaxStaleness() const
+{
+	return mPublishMaxStaleness;
+}
+
+void Settings::setPublishMaxStaleness(int v)
+{
+	if (mPublishMaxStaleness == v)
+		return;
+	mPublishMaxStaleness = v;
+	emit publishPolicyChanged();
+}
+
+int Settings::telemetryInterval() const
+{
+	return mTelemetryInterval;
+}
+
+void Settings::setTelemetryInterval(int v)
+{
+	if (mTelemetryInterval == v)
+		return;
+	mTelemetryInterval = v;
+	emit pollIntervalsChanged();
+}
+
+int Settings::statusInterval() const
+{
+	return mStatusInterval;
+}
+
+void Settings::setStatusInterval(int v)
+{
+	if (mStatusInterval == v)
+		return;
+	mStatusInterval = v;
+	emit pollIntervalsChanged();
+}
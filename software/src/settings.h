@@ -12,6 +12,15 @@ class Settings : public QObject
 {
 	Q_OBJECT
 	Q_PROPERTY(QStringList deviceIds READ deviceIds WRITE setDeviceIds NOTIFY deviceIdsChanged)
+	Q_PROPERTY(QStringList knownDevices READ knownDevices WRITE setKnownDevices NOTIFY knownDevicesChanged)
+	Q_PROPERTY(double currentDeadband READ currentDeadband WRITE setCurrentDeadband NOTIFY publishPolicyChanged)
+	Q_PROPERTY(double voltageDeadband READ voltageDeadband WRITE setVoltageDeadband NOTIFY publishPolicyChanged)
+	Q_PROPERTY(double powerDeadband READ powerDeadband WRITE setPowerDeadband NOTIFY publishPolicyChanged)
+	Q_PROPERTY(double relativeDeadband READ relativeDeadband WRITE setRelativeDeadband NOTIFY publishPolicyChanged)
+	Q_PROPERTY(int publishMinInterval READ publishMinInterval WRITE setPublishMinInterval NOTIFY publishPolicyChanged)
+	Q_PROPERTY(int publishMaxStaleness READ publishMaxStaleness WRITE setPublishMaxStaleness NOTIFY publishPolicyChanged)
+	Q_PROPERTY(int telemetryInterval READ telemetryInterval WRITE setTelemetryInterval NOTIFY pollIntervalsChanged)
+	Q_PROPERTY(int statusInterval READ statusInterval WRITE setStatusInterval NOTIFY pollIntervalsChanged)
 public:
 	explicit Settings(QObject *parent = 0);
 
@@ -21,11 +30,106 @@ public:
 
 	void registerDevice(const QString &serial);
 
+	/*!
+	 * Slave addresses where batteries have been found. Each entry has the
+	 * form 'port:address=serial' (eg. '/dev/ttyUSB0:3=1234').
+	 */
+	const QStringList &knownDevices() const;
+
+	void setKnownDevices(const QStringList &devices);
+
+	/*!
+	 * Stores the address of the battery with `serial`. Earlier entries of
+	 * the same battery, or of the same address, are replaced.
+	 */
+	void registerAddress(const QString &portName, int address,
+						 const QString &serial);
+
+	/*!
+	 * Returns the addresses on `portName` where batteries have been found.
+	 */
+	QList<int> knownAddresses(const QString &portName) const;
+
+	/*!
+	 * Changes of the battery current (A) smaller than this value are not
+	 * published on the D-Bus.
+	 */
+	double currentDeadband() const;
+
+	void setCurrentDeadband(double v);
+
+	/*!
+	 * Deadband (V) of the battery voltage.
+	 */
+	double voltageDeadband() const;
+
+	void setVoltageDeadband(double v);
+
+	/*!
+	 * Deadband (W) of the battery power.
+	 */
+	double powerDeadband() const;
+
+	void setPowerDeadband(double v);
+
+	/*!
+	 * Deadband of all battery measurements, as a fraction of the last
+	 * published value.
+	 */
+	double relativeDeadband() const;
+
+	void setRelativeDeadband(double v);
+
+	/*!
+	 * Minimum interval (ms) between 2 updates of a battery measurement.
+	 */
+	int publishMinInterval() const;
+
+	void setPublishMinInterval(int v);
+
+	/*!
+	 * Interval (ms) after which battery measurements are published again,
+	 * even if they did not change. Zero disables this.
+	 */
+	int publishMaxStaleness() const;
+
+	void setPublishMaxStaleness(int v);
+
+	/*!
+	 * Target interval (ms) between 2 reads of the battery measurements
+	 * (voltage, current, etc.).
+	 */
+	int telemetryInterval() const;
+
+	void setTelemetryInterval(int v);
+
+	/*!
+	 * Target interval (ms) between 2 reads of the status registers.
+	 */
+	int statusInterval() const;
+
+	void setStatusInterval(int v);
+
 signals:
 	void deviceIdsChanged();
 
+	void knownDevicesChanged();
+
+	void publishPolicyChanged();
+
+	void pollIntervalsChanged();
+
 private:
 	QStringList mDeviceIds;
+	QStringList mKnownDevices;
+	double mCurrentDeadband;
+	double mVoltageDeadband;
+	double mPowerDeadband;
+	double mRelativeDeadband;
+	int mPublishMinInterval;
+	int mPublishMaxStaleness;
+	int mTelemetryInterval;
+	int mStatusInterval;
 
 };
 
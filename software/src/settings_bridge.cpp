@@ -5,18 +5,41 @@
 
 static const QString Service = "com.victronenergy.settings";
 static const QString DeviceIdsPath = "/Settings/Redflow/DeviceIds";
+static const QString KnownDevicesPath = "/Settings/Redflow/KnownDevices";
 static const QString AcPowerSetPointPath = "/Settings/Redflow/AcPowerSetPoint";
+static const QString PublishPrefix = "/Settings/Redflow/Publish";
+static const QString PollPrefix = "/Settings/Redflow/Poll";
 
 SettingsBridge::SettingsBridge(Settings *settings, QObject *parent):
 	DBusBridge(parent)
 {
 	consume(Service, settings, "deviceIds", QVariant(""), DeviceIdsPath);
+	consume(Service, settings, "knownDevices", QVariant(""), KnownDevicesPath);
+	// Limits on the number of updates of the battery measurements. The
+	// defaults publish every change.
+	consume(Service, settings, "currentDeadband", 0.0, 0.0, 100.0,
+			PublishPrefix + "/CurrentDeadband");
+	consume(Service, settings, "voltageDeadband", 0.0, 0.0, 10.0,
+			PublishPrefix + "/VoltageDeadband");
+	consume(Service, settings, "powerDeadband", 0.0, 0.0, 1e4,
+			PublishPrefix + "/PowerDeadband");
+	consume(Service, settings, "relativeDeadband", 0.0, 0.0, 1.0,
+			PublishPrefix + "/RelativeDeadband");
+	consume(Service, settings, "publishMinInterval", 0, 0, 60000,
+			PublishPrefix + "/MinInterval");
+	consume(Service, settings, "publishMaxStaleness", 0, 0, 3600000,
+			PublishPrefix + "/MaxStaleness");
+	// Target intervals (ms) of the acquisition on the Modbus.
+	consume(Service, settings, "telemetryInterval", 1000, 100, 60000,
+			PollPrefix + "/TelemetryInterval");
+	consume(Service, settings, "statusInterval", 30000, 1000, 3600000,
+			PollPrefix + "/StatusInterval");
 	//consume(Service, settings, "acPowerSetPoint", 0.0, -1e5, 1e5, AcPowerSetPointPath);
 }
 
 bool SettingsBridge::toDBus(const QString &path, QVariant &value)
 {
-	if (path == DeviceIdsPath) {
+	if (path == DeviceIdsPath || path == KnownDevicesPath) {
 		value = value.value<QStringList>().join(",");
 	}
 	return true;
@@ -24,7 +47,7 @@ bool SettingsBridge::toDBus(const QString &path, QVariant &value)
 
 bool SettingsBridge::fromDBus(const QString &path, QVariant &value)
 {
-	if (path == DeviceIdsPath) {
+	if (path == DeviceIdsPath || path == KnownDevicesPath) {
 		value = value.toString().split(',', QString::SkipEmptyParts);
 	}
 	return true;
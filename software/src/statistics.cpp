@@ -0,0 +1,235 @@
+#include <QStringList>
+#include <QTimer>
+#include "dbus_bridge.h"
+#include "modbus_counters.h"
+#include "statistics.h"
+
+static const int UpdateInterval = 1000;
+
+static double toRate(int count, qint64 interval)
+{
+	return interval <= 0 ? 0 : (1000.0 * count) / interval;
+}
+
+SlaveStatistics::SlaveStatistics(int slaveAddress, QObject *parent):
+	QObject(parent),
+	mSlaveAddress(slaveAddress),
+	mReplies(0),
+	mLatencyP50(0),
+	mLatencyP90(0),
+	mLatencyP99(0),
+	mPollInterval(0),
+	mTargetPollInterval(0)
+{
+}
+
+int SlaveStatistics::slaveAddress() const
+{
+	return mSlaveAddress;
+}
+
+int SlaveStatistics::replies() const
+{
+	return mReplies;
+}
+
+double SlaveStatistics::latencyP50() const
+{
+	return mLatencyP50;
+}
+
+double SlaveStatistics::latencyP90() const
+{
+	return mLatencyP90;
+}
+
+double SlaveStatistics::latencyP99() const
+{
+	return mLatencyP99;
+}
+
+int SlaveStatistics::pollInterval() const
+{
+	return mPollInterval;
+}
+
+int SlaveStatistics::targetPollInterval() const
+{
+	return mTargetPollInterval;
+}
+
+void SlaveStatistics::update(const ModbusCounters &counters)
+{
+	const LatencyHistogram &latency = counters.latency[mSlaveAddress];
+	int replies = latency.count();
+	int pollInterval = counters.pollInterval[mSlaveAddress];
+	int targetPollInterval = counters.targetPollInterval[mSlaveAddress];
+	if (replies == mReplies && pollInterval == mPollInterval &&
+		targetPollInterval == mTargetPollInterval)
+		return;
+	mReplies = replies;
+	mPollInterval = pollInterval;
+	mTargetPollInterval = targetPollInterval;
+	mLatencyP50 = latency.percentile(50) / 1000.0;
+	mLatencyP90 = latency.percentile(90) / 1000.0;
+	mLatencyP99 = latency.percentile(99) / 1000.0;
+	emit statisticsChanged();
+}
+
+BusStatistics::BusStatistics(const QString &portName,
+							 const ModbusCounters *counters, QObject *parent):
+	QObject(parent),
+	mPortName(portName),
+	mCounters(counters),
+	mLastTransactions(0),
+	mTransactionRate(0),
+	mCrcErrors(0),
+	mTimeouts(0),
+	mExceptions(0),
+	mQueueDepth(0),
+	mMaxQueueDepth(0),
+	mSweepTimeP50(0),
+	mSweepTimeP99(0)
+{
+}
+
+QString BusStatistics::portName() const
+{
+	return mPortName;
+}
+
+double BusStatistics::transactionRate() const
+{
+	return mTransactionRate;
+}
+
+int BusStatistics::crcErrors() const
+{
+	return mCrcErrors;
+}
+
+int BusStatistics::timeouts() const
+{
+	return mTimeouts;
+}
+
+int BusStatistics::exceptions() const
+{
+	return mExceptions;
+}
+
+QString BusStatistics::exceptionCodes() const
+{
+	return mExceptionCodes;
+}
+
+int BusStatistics::queueDepth() const
+{
+	return mQueueDepth;
+}
+
+int BusStatistics::maxQueueDepth() const
+{
+	return mMaxQueueDepth;
+}
+
+double BusStatistics::sweepTimeP50() const
+{
+	return mSweepTimeP50;
+}
+
+double BusStatistics::sweepTimeP99() const
+{
+	return mSweepTimeP99;
+}
+
+SlaveStatistics *BusStatistics::addSlave(int slaveAddress)
+{
+	foreach (SlaveStatistics *s, mSlaves) {
+		if (s->slaveAddress() == slaveAddress)
+			return s;
+	}
+	SlaveStatistics *s = new SlaveStatistics(slaveAddress, this);
+	mSlaves.append(s);
+	emit slaveAdded(s);
+	return s;
+}
+
+void BusStatistics::update(qint64 interval)
+{
+	const ModbusCounters &c = *mCounters;
+	int transactions = c.transactions;
+	mTransactionRate = toRate(transactions - mLastTransactions, interval);
+	mLastTransactions = transactions;
+	mCrcErrors = c.crcErrors;
+	mTimeouts = c.timeouts;
+	mExceptions = 0;
+	QStringList codes;
+	for (int i=0; i<16; ++i) {
+		int count = c.exceptions[i];
+		if (count == 0)
+			continue;
+		mExceptions += count;
+		codes.append(QString("%1:%2").arg(i).arg(count));
+	}
+	mExceptionCodes = codes.join(",");
+	mQueueDepth = c.queueDepth;
+	mMaxQueueDepth = c.maxQueueDepth;
+	mSweepTimeP50 = c.sweepTime.percentile(50) / 1000.0;
+	mSweepTimeP99 = c.sweepTime.percentile(99) / 1000.0;
+	emit statisticsChanged();
+	foreach (SlaveStatistics *s, mSlaves)
+		s->update(c);
+}
+
+Statistics::Statistics(QObject *parent):
+	QObject(parent),
+	mUpdateTimer(new QTimer(this)),
+	mLastPropertiesChanged(DBusBridge::propertiesChangedCount()),
+	mLastItemsChanged(DBusBridge::itemsChangedCount()),
+	mPropertiesChangedRate(0),
+	mItemsChangedRate(0)
+{
+	mInterval.start();
+	mUpdateTimer->setInterval(UpdateInterval);
+	connect(mUpdateTimer, SIGNAL(timeout()), this, SLOT(onUpdateTimer()));
+	mUpdateTimer->start();
+}
+
+double Statistics::propertiesChangedRate() const
+{
+	return mPropertiesChangedRate;
+}
+
+double Statistics::itemsChangedRate() const
+{
+	return mItemsChangedRate;
+}
+
+BusStatistics *Statistics::addBus(const QString &portName,
+								  const ModbusCounters *counters)
+{
+	BusStatistics *bus = new BusStatistics(portName, counters, this);
+	mBuses.append(bus);
+	return bus;
+}
+
+QList<BusStatistics *> Statistics::buses() const
+{
+	return mBuses;
+}
+
+void Statistics::onUpdateTimer()
+{
+	qint64 interval = mInterval.restart();
+	int propertiesChanged = DBusBridge::propertiesChangedCount();
+	int itemsChanged = DBusBridge::itemsChangedCount();
+	mPropertiesChangedRate =
+			toRate(propertiesChanged - mLastPropertiesChanged, interval);
+	mItemsChangedRate = toRate(itemsChanged - mLastItemsChanged, interval);
+	mLastPropertiesChanged = propertiesChanged;
+	mLastItemsChanged = itemsChanged;
+	emit statisticsChanged();
+	foreach (BusStatistics *bus, mBuses)
+		bus->update(interval);
+}
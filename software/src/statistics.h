@@ -0,0 +1,180 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+#include <QString>
+
+struct ModbusCounters;
+class QTimer;
+
+/*!
+ * Response times of a single slave, taken from the `ModbusCounters` of its
+ * connection. All latencies are in milliseconds.
+ */
+class SlaveStatistics : public QObject
+{
+	Q_OBJECT
+	Q_PROPERTY(int slaveAddress READ slaveAddress)
+	Q_PROPERTY(int replies READ replies NOTIFY statisticsChanged)
+	Q_PROPERTY(double latencyP50 READ latencyP50 NOTIFY statisticsChanged)
+	Q_PROPERTY(double latencyP90 READ latencyP90 NOTIFY statisticsChanged)
+	Q_PROPERTY(double latencyP99 READ latencyP99 NOTIFY statisticsChanged)
+	Q_PROPERTY(int pollInterval READ pollInterval NOTIFY statisticsChanged)
+	Q_PROPERTY(int targetPollInterval READ targetPollInterval NOTIFY statisticsChanged)
+public:
+	SlaveStatistics(int slaveAddress, QObject *parent = 0);
+
+	int slaveAddress() const;
+
+	int replies() const;
+
+	double latencyP50() const;
+
+	double latencyP90() const;
+
+	double latencyP99() const;
+
+	/// Achieved interval (ms) between 2 reads of the telemetry
+	int pollInterval() const;
+
+	/// Configured interval (ms) between 2 reads of the telemetry
+	int targetPollInterval() const;
+
+	void update(const ModbusCounters &counters);
+
+signals:
+	void statisticsChanged();
+
+private:
+	int mSlaveAddress;
+	int mReplies;
+	double mLatencyP50;
+	double mLatencyP90;
+	double mLatencyP99;
+	int mPollInterval;
+	int mTargetPollInterval;
+};
+
+/*!
+ * Statistics of a single Modbus connection.
+ * The values are taken from the `ModbusCounters` of the connection each time
+ * `update` is called. Rates are computed over the interval between 2 updates.
+ */
+class BusStatistics : public QObject
+{
+	Q_OBJECT
+	Q_PROPERTY(QString portName READ portName)
+	Q_PROPERTY(double transactionRate READ transactionRate NOTIFY statisticsChanged)
+	Q_PROPERTY(int crcErrors READ crcErrors NOTIFY statisticsChanged)
+	Q_PROPERTY(int timeouts READ timeouts NOTIFY statisticsChanged)
+	Q_PROPERTY(int exceptions READ exceptions NOTIFY statisticsChanged)
+	Q_PROPERTY(QString exceptionCodes READ exceptionCodes NOTIFY statisticsChanged)
+	Q_PROPERTY(int queueDepth READ queueDepth NOTIFY statisticsChanged)
+	Q_PROPERTY(int maxQueueDepth READ maxQueueDepth NOTIFY statisticsChanged)
+	Q_PROPERTY(double sweepTimeP50 READ sweepTimeP50 NOTIFY statisticsChanged)
+	Q_PROPERTY(double sweepTimeP99 READ sweepTimeP99 NOTIFY statisticsChanged)
+public:
+	/*!
+	 * `counters` is not owned by the new object, and should outlive it.
+	 */
+	BusStatistics(const QString &portName, const ModbusCounters *counters,
+				  QObject *parent = 0);
+
+	QString portName() const;
+
+	/// Number of requests sent per second
+	double transactionRate() const;
+
+	int crcErrors() const;
+
+	int timeouts() const;
+
+	/// Total number of exception replies
+	int exceptions() const;
+
+	/*!
+	 * Number of exception replies per exception code, formatted as
+	 * 'code:count' pairs separated by commas (eg. '2:5,6:1').
+	 */
+	QString exceptionCodes() const;
+
+	int queueDepth() const;
+
+	int maxQueueDepth() const;
+
+	/// Time needed to retrieve all values of a battery (milliseconds)
+	double sweepTimeP50() const;
+
+	double sweepTimeP99() const;
+
+	/*!
+	 * Starts collecting the response times of `slaveAddress`.
+	 */
+	SlaveStatistics *addSlave(int slaveAddress);
+
+	void update(qint64 interval);
+
+signals:
+	void statisticsChanged();
+
+	void slaveAdded(SlaveStatistics *slave);
+
+private:
+	QString mPortName;
+	const ModbusCounters *mCounters;
+	QList<SlaveStatistics *> mSlaves;
+	int mLastTransactions;
+	double mTransactionRate;
+	int mCrcErrors;
+	int mTimeouts;
+	int mExceptions;
+	QString mExceptionCodes;
+	int mQueueDepth;
+	int mMaxQueueDepth;
+	double mSweepTimeP50;
+	double mSweepTimeP99;
+};
+
+/*!
+ * Collects performance statistics of the whole process: the Modbus
+ * connections (see `BusStatistics`), and the updates sent to the D-Bus.
+ * The statistics are refreshed every second.
+ */
+class Statistics : public QObject
+{
+	Q_OBJECT
+	Q_PROPERTY(double propertiesChangedRate READ propertiesChangedRate NOTIFY statisticsChanged)
+	Q_PROPERTY(double itemsChangedRate READ itemsChangedRate NOTIFY statisticsChanged)
+public:
+	explicit Statistics(QObject *parent = 0);
+
+	/// Number of PropertiesChanged signals sent per second
+	double propertiesChangedRate() const;
+
+	/// Number of ItemsChanged signals sent per second
+	double itemsChangedRate() const;
+
+	BusStatistics *addBus(const QString &portName,
+						  const ModbusCounters *counters);
+
+	QList<BusStatistics *> buses() const;
+
+signals:
+	void statisticsChanged();
+
+private slots:
+	void onUpdateTimer();
+
+private:
+	QTimer *mUpdateTimer;
+	QElapsedTimer mInterval;
+	QList<BusStatistics *> mBuses;
+	int mLastPropertiesChanged;
+	int mLastItemsChanged;
+	double mPropertiesChangedRate;
+	double mItemsChangedRate;
+};
+
+#endif // STATISTICS_H
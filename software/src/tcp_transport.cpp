@@ -0,0 +1,87 @@
+#include <QsLog.h>
+#include <QTcpSocket>
+#include <QTimer>
+#include "tcp_transport.h"
+
+static const int ReconnectInterval = 5000;
+// Number of Modbus TCP requests sent without waiting for the reply. Most
+// gateways handle a few pending requests, but forward them to the serial bus
+// one by one.
+static const int MaxTcpInFlight = 4;
+
+TcpTransport::TcpTransport(const QString &hostName, quint16 port,
+						   Framing framing, QObject *parent):
+	ModbusTransport(parent),
+	mSocket(new QTcpSocket(this)),
+	mReconnectTimer(new QTimer(this)),
+	mHostName(hostName),
+	mPort(port),
+	mFraming(framing)
+{
+	connect(mSocket, SIGNAL(connected()), this, SLOT(onConnected()));
+	connect(mSocket, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+	connect(mSocket, SIGNAL(error(QAbstractSocket::SocketError)),
+			this, SLOT(onError(QAbstractSocket::SocketError)));
+	connect(mSocket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+	mReconnectTimer->setSingleShot(true);
+	mReconnectTimer->setInterval(ReconnectInterval);
+	connect(mReconnectTimer, SIGNAL(timeout()), this, SLOT(onReconnectTimer()));
+	mSocket->connectToHost(mHostName, mPort);
+}
+
+ModbusTransport::Framing TcpTransport::framing() const
+{
+	return mFraming;
+}
+
+int TcpTransport::maxInFlight() const
+{
+	return mFraming == MbapFraming ? MaxTcpInFlight : 1;
+}
+
+void TcpTransport::send(const quint8 *data, int length)
+{
+	if (mSocket->state() != QAbstractSocket::ConnectedState)
+		return;
+	mSocket->write(reinterpret_cast<const char *>(data), length);
+}
+
+void TcpTransport::onConnected()
+{
+	QLOG_INFO() << "Connected to" << mHostName << "port" << mPort;
+	// Modbus frames are small, and should not be delayed by the Nagle
+	// algorithm.
+	mSocket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+}
+
+void TcpTransport::onDisconnected()
+{
+	QLOG_WARN() << "Connection to" << mHostName << "lost";
+	mReconnectTimer->start();
+}
+
+void TcpTransport::onError(QAbstractSocket::SocketError error)
+{
+	Q_UNUSED(error);
+	QLOG_WARN() << "Socket error:" << mSocket->errorString();
+	if (mSocket->state() != QAbstractSocket::ConnectedState)
+		mReconnectTimer->start();
+}
+
+void TcpTransport::onReadyRead()
+{
+	quint8 buffer[512];
+	for (;;) {
+		qint64 length = mSocket->read(reinterpret_cast<char *>(buffer),
+									  sizeof(buffer));
+		if (length <= 0)
+			break;
+		emit dataReceived(buffer, static_cast<int>(length));
+	}
+}
+
+void TcpTransport::onReconnectTimer()
+{
+	mSocket->abort();
+	mSocket->connectToHost(mHostName, mPort);
+}
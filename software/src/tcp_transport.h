@@ -0,0 +1,52 @@
+#ifndef TCP_TRANSPORT_H
+#define TCP_TRANSPORT_H
+
+#include <QAbstractSocket>
+#include "modbus_transport.h"
+
+class QTcpSocket;
+class QTimer;
+
+/*!
+ * Modbus over a TCP connection, for slaves behind an Ethernet gateway.
+ * With `MbapFraming` the gateway is addressed using Modbus TCP, and several
+ * requests may be sent before the first reply comes in. With `RtuFraming`
+ * the RTU frames are tunneled through the connection as they are
+ * (RTU over TCP). RTU frames do not carry a transaction ID, so only a single
+ * request may be pending in that case.
+ * The connection is reestablished automatically when it is lost. Requests
+ * sent while the connection is down will time out.
+ */
+class TcpTransport : public ModbusTransport
+{
+	Q_OBJECT
+public:
+	TcpTransport(const QString &hostName, quint16 port, Framing framing,
+				 QObject *parent = 0);
+
+	virtual Framing framing() const;
+
+	virtual int maxInFlight() const;
+
+	virtual void send(const quint8 *data, int length);
+
+private slots:
+	void onConnected();
+
+	void onDisconnected();
+
+	void onError(QAbstractSocket::SocketError error);
+
+	void onReadyRead();
+
+	void onReconnectTimer();
+
+private:
+	QTcpSocket *mSocket;
+	QTimer *mReconnectTimer;
+	QString mHostName;
+	quint16 mPort;
+	Framing mFraming;
+};
+
+#endif // TCP_TRANSPORT_H
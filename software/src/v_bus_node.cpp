@@ -1,3 +1,4 @@
+#include <QDBusMetaType>
 #include <QList>
 #include <velib/qt/v_busitem.h>
 #include "v_bus_node.h"
@@ -16,6 +17,7 @@ static QString combine(const QString &lhs, const QString &rhs)
 VBusNode::VBusNode(QDBusConnection &connection, const QString &path,
 				   QObject *parent) :
 	QDBusAbstractAdaptor(new QObject(parent)),
+	mSnapshotValid(false),
 	mConnection(connection)
 {
 	// We need some trickery to get the adaptor running. A QDBusAbstractAdaptor
@@ -23,6 +25,7 @@ VBusNode::VBusNode(QDBusConnection &connection, const QString &path,
 	// of the subclass (this class) to retrieve the data from that class.
 	// This class does not do that, but the QT DBus framework still expects a
 	// unique parent for each adapter.
+	qDBusRegisterMetaType<VBusItemChanges>();
 	connection.registerObject(path, this->parent());
 }
 
@@ -108,11 +111,26 @@ QStringList VBusNode::enumeratePaths() const
 	return result;
 }
 
+void VBusNode::notifyItemsChanged(const VBusItemChanges &changes)
+{
+	emit ItemsChanged(changes);
+}
+
 QDBusVariant VBusNode::GetValue()
 {
-	QVariantMap result;
-	addToMap(QString(), result);
-	return QDBusVariant(result);
+	if (!mSnapshotValid) {
+		mSnapshot.clear();
+		for (QHash<VBusItem *, QString>::const_iterator it = mItemPaths.begin();
+			 it != mItemPaths.end();
+			 ++it) {
+			QVariant v = it.key()->getValue();
+			if (!v.isValid())
+				v = QVariant::fromValue(QList<int>());
+			mSnapshot.insert(it.value(), v);
+		}
+		mSnapshotValid = true;
+	}
+	return QDBusVariant(mSnapshot);
 }
 
 void VBusNode::onItemDeleted()
@@ -139,21 +157,15 @@ void VBusNode::onNodeDeleted()
 		deleteLater();
 }
 
-void VBusNode::addToMap(const QString &prefix, QVariantMap &map)
+void VBusNode::onDescendantChanged()
 {
-	for (QMap<QString, VBusItem *>::iterator it = mLeafs.begin();
-		 it != mLeafs.end();
-		 ++it) {
-		QVariant v = it.value()->getValue();
-		if (!v.isValid())
-			v = QVariant::fromValue(QList<int>());
-		map[combine(prefix, it.key())] = v;
-	}
-	for (QMap<QString, VBusNode *>::iterator it = mNodes.begin();
-		 it != mNodes.end();
-		 ++it) {
-		it.value()->addToMap(combine(prefix, it.key()), map);
-	}
+	mSnapshotValid = false;
+}
+
+void VBusNode::onDescendantDeleted()
+{
+	mItemPaths.remove(static_cast<VBusItem *>(sender()));
+	mSnapshotValid = false;
 }
 
 void VBusNode::addChild(const QString &nodePath, const QString &subPath,
@@ -161,6 +173,12 @@ void VBusNode::addChild(const QString &nodePath, const QString &subPath,
 {
 	Q_ASSERT(nodePath.startsWith('/'));
 	Q_ASSERT(subPath.startsWith('/'));
+	// Each node along the path keeps the path of the item, so GetValue does
+	// not have to walk the substructure.
+	mItemPaths.insert(item, subPath.mid(1));
+	mSnapshotValid = false;
+	connect(item, SIGNAL(valueChanged()), this, SLOT(onDescendantChanged()));
+	connect(item, SIGNAL(destroyed()), this, SLOT(onDescendantDeleted()));
 	int i = subPath.indexOf('/', 1);
 	if (i == -1) {
 		connect(item, SIGNAL(destroyed()), this, SLOT(onItemDeleted()));
@@ -4,10 +4,20 @@
 #include <QDBusAbstractAdaptor>
 #include <QDBusVariant>
 #include <QDBusConnection>
+#include <QHash>
 #include <QMap>
+#include <QMetaType>
 
 class VBusItem;
 
+/*!
+ * Changed items of a service: maps the path of each item to a map
+ * containing the `Value` and `Text` of the item (D-Bus signature a{sa{sv}}).
+ */
+typedef QMap<QString, QVariantMap> VBusItemChanges;
+
+Q_DECLARE_METATYPE(VBusItemChanges)
+
 /*!
  * @brief A D-Bus item that creates a map of its substructure when its
  * GetValue function is called.
@@ -16,6 +26,11 @@ class VBusItem;
  * function. The root object will create additional `VbusNode` objects for all
  * nodes it the D-Bus structure. The GetValue function of each node will return
  * a map with all paths and value of its substructure.
+ * The root node also provides the `ItemsChanged` signal, which reports the
+ * changes of many items in a single D-Bus message. The `PropertiesChanged`
+ * signals of the items themselves are still sent for older clients.
+ * The result of GetValue is cached, and only rebuilt when an item in the
+ * substructure has changed.
  * @note A `VBusNode` will delete itself (by calling `deleteLater` when all its
  * children (`VBusNode`s and `VBusItem`s are deleted). If you delete `VBusItem`s
  * dynamically, use a `QPointer` to store the pointer to the root node and check
@@ -68,25 +83,40 @@ public:
 	 */
 	QStringList enumeratePaths() const;
 
+	/*!
+	 * @brief Emits the `ItemsChanged` signal.
+	 * Should be called on the root node, with absolute paths.
+	 */
+	void notifyItemsChanged(const VBusItemChanges &changes);
+
 public slots:
 	QDBusVariant GetValue();
 
 signals:
 	void PropertiesChanged(const QVariantMap &changes);
 
+	void ItemsChanged(const VBusItemChanges &changes);
+
 private slots:
 	void onItemDeleted();
 
 	void onNodeDeleted();
 
-private:
-	void addToMap(const QString &prefix, QVariantMap &map);
+	void onDescendantChanged();
 
+	void onDescendantDeleted();
+
+private:
 	void addChild(const QString &nodePath, const QString &subPath,
 				  VBusItem *item);
 
 	QMap<QString, VBusItem *> mLeafs;
 	QMap<QString, VBusNode *> mNodes;
+	// Paths (relative to this node) of all items in the substructure
+	QHash<VBusItem *, QString> mItemPaths;
+	// Result of GetValue, valid while no item in the substructure changes
+	QVariantMap mSnapshot;
+	bool mSnapshotValid;
 	QDBusConnection mConnection;
 };
 
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <sys/resource.h>
+#include <QDBusConnection>
+#include <QDBusVariant>
+#include <QsLog.h>
+#include <QTimer>
+#include "benchmark.h"
+#include "zbm_simulator.h"
+
+static const int ReadHoldingRegisters = 3;
+static const int RegBattVolts = 0x9013;
+// Voltages used by the benchmark (0.1 V). They are outside the range used by
+// the simulator itself.
+static const quint16 FirstVoltage = 1000;
+static const quint16 LastVoltage = 9999;
+
+/*!
+ * Returns the CPU time used by all threads of the process in microseconds.
+ */
+static qint64 cpuTime()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * Q_INT64_C(1000000) +
+			usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+Benchmark::Benchmark(ZbmSimulator *simulator, QDBusConnection &connection,
+					 int cycles, int timeout, QObject *parent):
+	QObject(parent),
+	mSimulator(simulator),
+	mCycles(qMax(2, cycles)),
+	mTimeoutTimer(new QTimer(this)),
+	mNextVoltage(FirstVoltage),
+	mPendingVoltage(0),
+	mVoltageReads(0),
+	mStartCpuTime(0),
+	mStartAllocations(0),
+	mStartTime(0),
+	mCpuTime(0),
+	mAllocations(0),
+	mDuration(0)
+{
+	// The simulator lives in this thread, so the direct connections below
+	// change the registers before the reply is built.
+	connect(mSimulator, SIGNAL(requestReceived(int, int, int, int)),
+			this, SLOT(onRequestReceived(int, int, int, int)),
+			Qt::DirectConnection);
+	connect(mSimulator, SIGNAL(replySent()),
+			this, SLOT(onReplySent()), Qt::DirectConnection);
+	// Any service may publish the voltage, so the sender is not specified.
+	if (!connection.connect(QString(), "/Dc/0/Voltage",
+							"com.victronenergy.BusItem", "PropertiesChanged",
+							this, SLOT(onPropertiesChanged(QVariantMap)))) {
+		QLOG_ERROR() << "Could not subscribe to PropertiesChanged";
+	}
+	mTimeoutTimer->setSingleShot(true);
+	mTimeoutTimer->setInterval(timeout * 1000);
+	connect(mTimeoutTimer, SIGNAL(timeout()), this, SLOT(onTimeout()));
+	mTimeoutTimer->start();
+	mClock.start();
+}
+
+bool Benchmark::completed() const
+{
+	return mLatencies.size() >= mCycles;
+}
+
+void Benchmark::printReport() const
+{
+	QVector<qint64> sorted = mLatencies;
+	qSort(sorted);
+	int samples = sorted.size();
+	// Percentile of the latency in milliseconds
+	double p[4] = { 0, 0, 0, 0 };
+	const int percentiles[3] = { 50, 90, 99 };
+	if (samples > 0) {
+		for (int i=0; i<3; ++i) {
+			int index = qMin(samples - 1, (samples * percentiles[i]) / 100);
+			p[i] = sorted[index] / 1000.0;
+		}
+		p[3] = sorted.last() / 1000.0;
+	}
+	int cycles = qMax(1, samples - 1);
+	printf("{\"completed\": %s, \"samples\": %d, \"voltage_reads\": %d, "
+		   "\"latency_ms\": {\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, "
+		   "\"max\": %.3f}, \"cycle_ms\": %.1f, \"cpu_ms_per_cycle\": %.3f, "
+		   "\"allocations_per_cycle\": %.1f}\n",
+		   completed() ? "true" : "false", samples, mVoltageReads,
+		   p[0], p[1], p[2], p[3],
+		   static_cast<double>(mDuration) / cycles,
+		   mCpuTime / 1000.0 / cycles,
+		   static_cast<double>(mAllocations) / cycles);
+	fflush(stdout);
+}
+
+void Benchmark::onRequestReceived(int address, int function, int reg,
+								  int count)
+{
+	if (function != ReadHoldingRegisters || reg > RegBattVolts ||
+		reg + count <= RegBattVolts)
+		return;
+	quint16 voltage = mNextVoltage;
+	mNextVoltage = mNextVoltage == LastVoltage ? FirstVoltage : mNextVoltage + 1;
+	if (mSimulator->setRegister(address, RegBattVolts, voltage))
+		mPendingVoltage = voltage;
+}
+
+void Benchmark::onReplySent()
+{
+	if (mPendingVoltage == 0)
+		return;
+	mSentTimes.insert(mPendingVoltage, mClock.nsecsElapsed() / 1000);
+	mPendingVoltage = 0;
+	++mVoltageReads;
+}
+
+void Benchmark::onPropertiesChanged(const QVariantMap &changes)
+{
+	qint64 now = mClock.nsecsElapsed() / 1000;
+	QVariant value = changes.value("Value");
+	if (value.userType() == qMetaTypeId<QDBusVariant>())
+		value = value.value<QDBusVariant>().variant();
+	quint16 voltage = static_cast<quint16>(qRound(value.toDouble() * 10));
+	QHash<quint16, qint64>::iterator it = mSentTimes.find(voltage);
+	if (it == mSentTimes.end())
+		return;
+	qint64 latency = now - it.value();
+	mSentTimes.erase(it);
+	addSample(latency);
+}
+
+void Benchmark::onTimeout()
+{
+	QLOG_ERROR() << "Benchmark timed out after" << mLatencies.size()
+				 << "samples";
+	// Tell a service stuck before acquisition (the voltage is never read)
+	// from one that does not publish the values it reads.
+	if (mVoltageReads == 0)
+		QLOG_ERROR() << "The battery voltage has never been read";
+	emit finished();
+}
+
+void Benchmark::addSample(qint64 latency)
+{
+	if (completed())
+		return;
+	if (mLatencies.isEmpty()) {
+		mStartCpuTime = cpuTime();
+		mStartAllocations = allocationCount();
+		mStartTime = mClock.elapsed();
+	}
+	mLatencies.append(latency);
+	QLOG_DEBUG() << "Sample" << mLatencies.size() << "latency"
+				 << latency << "us";
+	mCpuTime = cpuTime() - mStartCpuTime;
+	mAllocations = allocationCount() - mStartAllocations;
+	mDuration = mClock.elapsed() - mStartTime;
+	if (completed()) {
+		mTimeoutTimer->stop();
+		emit finished();
+	}
+}
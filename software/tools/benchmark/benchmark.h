@@ -0,0 +1,93 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QVariantMap>
+#include <QVector>
+
+class QDBusConnection;
+class QTimer;
+class ZbmSimulator;
+
+/*!
+ * Measures the performance of the whole pipeline: from a Modbus reply sent by
+ * a simulated battery to the `PropertiesChanged` signal of the D-Bus item.
+ *
+ * Each time the simulator receives a request for the battery voltage, the
+ * voltage is set to a new, unique value. The time the reply is written is
+ * stored, and compared with the time the new value is reported on the D-Bus.
+ * Each acquisition cycle of the battery yields a single sample.
+ *
+ * CPU time and the number of memory allocations (see `allocationCount`) are
+ * measured over all threads of the process, so they include the simulator
+ * and the D-Bus client. Both are small compared to dbus-redflow itself.
+ */
+class Benchmark : public QObject
+{
+	Q_OBJECT
+public:
+	/*!
+	 * @param connection Connection to the bus on which dbus-redflow publishes
+	 * its services.
+	 * @param cycles Number of samples to collect.
+	 * @param timeout Maximum duration of the benchmark in seconds.
+	 */
+	Benchmark(ZbmSimulator *simulator, QDBusConnection &connection,
+			  int cycles, int timeout, QObject *parent = 0);
+
+	/*!
+	 * Returns true if all samples have been collected.
+	 */
+	bool completed() const;
+
+	/*!
+	 * Writes the results to stdout, formatted as a single JSON object.
+	 */
+	void printReport() const;
+
+signals:
+	void finished();
+
+private slots:
+	void onRequestReceived(int address, int function, int reg, int count);
+
+	void onReplySent();
+
+	void onPropertiesChanged(const QVariantMap &changes);
+
+	void onTimeout();
+
+private:
+	void addSample(qint64 latency);
+
+	ZbmSimulator *mSimulator;
+	int mCycles;
+	QTimer *mTimeoutTimer;
+	QElapsedTimer mClock;
+	quint16 mNextVoltage;
+	// Voltage set for the request being handled (0 if none)
+	quint16 mPendingVoltage;
+	// Number of replies containing the battery voltage
+	int mVoltageReads;
+	// Time (in microseconds on `mClock`) each voltage has been sent
+	QHash<quint16, qint64> mSentTimes;
+	QVector<qint64> mLatencies;
+	// Measurement window: from the first sample to the last one
+	qint64 mStartCpuTime;
+	int mStartAllocations;
+	qint64 mStartTime;
+	// CPU time (us), allocations, and time (ms) since the first sample
+	qint64 mCpuTime;
+	int mAllocations;
+	qint64 mDuration;
+};
+
+/*!
+ * Returns the number of memory allocations (malloc, calloc, realloc, and
+ * therefore also `new`) since the start of the process.
+ */
+int allocationCount();
+
+#endif // BENCHMARK_H
@@ -0,0 +1,101 @@
+# End-to-end benchmark: runs dbus-redflow against simulated batteries, and
+# measures the time from a Modbus reply to the D-Bus signal reporting the new
+# value.
+
+QT += core dbus network
+QT -= gui
+
+TARGET = redflow-benchmark
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+# suppress the mangling of va_arg has changed for gcc 4.4
+QMAKE_CXXFLAGS += -Wno-psabi
+
+SRC = ../../src
+EXT = ../../ext
+
+include($$EXT/qslog/QsLog.pri)
+
+INCLUDEPATH += \
+    $$EXT/qslog \
+    $$EXT/velib/inc \
+    $$EXT/velib/inc/velib/platform \
+    $$SRC \
+    ../zbm-simulator \
+    ../..
+
+SOURCES += \
+    $$EXT/velib/src/qt/v_busitem.cpp \
+    $$EXT/velib/src/qt/v_busitems.cpp \
+    $$EXT/velib/src/qt/v_busitem_adaptor.cpp \
+    $$EXT/velib/src/qt/v_busitem_private_cons.cpp \
+    $$EXT/velib/src/qt/v_busitem_private_prod.cpp \
+    $$EXT/velib/src/qt/v_busitem_proxy.cpp \
+    $$EXT/velib/src/plt/serial.c \
+    $$EXT/velib/src/plt/posix_serial.c \
+    $$EXT/velib/src/plt/posix_ctx.c \
+    $$EXT/velib/src/types/ve_variant.c \
+    $$SRC/dbus_bridge.cpp \
+    $$SRC/modbus_rtu.cpp \
+    $$SRC/modbus_counters.cpp \
+    $$SRC/modbus_transport.cpp \
+    $$SRC/serial_transport.cpp \
+    $$SRC/tcp_transport.cpp \
+    $$SRC/recording_transport.cpp \
+    $$SRC/replay_transport.cpp \
+    $$SRC/v_bus_node.cpp \
+    $$SRC/crc16.cpp \
+    $$SRC/settings.cpp \
+    $$SRC/settings_bridge.cpp \
+    $$SRC/dbus_service_monitor.cpp \
+    $$SRC/battery_controller_settings.cpp \
+    $$SRC/battery_controller_settings_bridge.cpp \
+    $$SRC/battery_controller_updater.cpp \
+    $$SRC/battery_controller_scanner.cpp \
+    $$SRC/bus_worker.cpp \
+    $$SRC/statistics.cpp \
+    $$SRC/debug_bridge.cpp \
+    $$SRC/sample_trace.cpp \
+    $$SRC/battery_controller_bridge.cpp \
+    $$SRC/batteryController.cpp \
+    $$SRC/dbus_redflow.cpp \
+    ../zbm-simulator/zbm_simulator.cpp \
+    benchmark.cpp \
+    main.cpp
+
+HEADERS += \
+    $$EXT/velib/src/qt/v_busitem_adaptor.h \
+    $$EXT/velib/src/qt/v_busitem_private_cons.h \
+    $$EXT/velib/src/qt/v_busitem_private_prod.h \
+    $$EXT/velib/src/qt/v_busitem_private.h \
+    $$EXT/velib/src/qt/v_busitem_proxy.h \
+    $$EXT/velib/inc/velib/qt/v_busitem.h \
+    $$EXT/velib/inc/velib/qt/v_busitems.h \
+    $$SRC/dbus_bridge.h \
+    $$SRC/modbus_rtu.h \
+    $$SRC/modbus_counters.h \
+    $$SRC/modbus_transport.h \
+    $$SRC/serial_transport.h \
+    $$SRC/tcp_transport.h \
+    $$SRC/recording_transport.h \
+    $$SRC/replay_transport.h \
+    $$SRC/v_bus_node.h \
+    $$SRC/settings.h \
+    $$SRC/settings_bridge.h \
+    $$SRC/dbus_service_monitor.h \
+    $$SRC/battery_controller_settings.h \
+    $$SRC/battery_controller_settings_bridge.h \
+    $$SRC/battery_controller_updater.h \
+    $$SRC/battery_controller_scanner.h \
+    $$SRC/bus_worker.h \
+    $$SRC/statistics.h \
+    $$SRC/debug_bridge.h \
+    $$SRC/sample_trace.h \
+    $$SRC/battery_controller_bridge.h \
+    $$SRC/batteryController.h \
+    $$SRC/dbus_redflow.h \
+    ../zbm-simulator/zbm_simulator.h \
+    benchmark.h
@@ -0,0 +1,196 @@
+#include <stdlib.h>
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QProcess>
+#include <QsLog.h>
+#include <QStringList>
+#include <velib/qt/v_busitems.h>
+#include "benchmark.h"
+#include "dbus_redflow.h"
+#include "zbm_simulator.h"
+
+// Count all memory allocations of the process. The functions below replace
+// the ones from the C library (glibc only).
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+}
+
+static QBasicAtomicInt Allocations = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+extern "C" {
+void *malloc(size_t size)
+{
+	Allocations.fetchAndAddRelaxed(1);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+	Allocations.fetchAndAddRelaxed(1);
+	return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	Allocations.fetchAndAddRelaxed(1);
+	return __libc_realloc(ptr, size);
+}
+
+// This function is called by the serial port API from velib when the device is
+// disconnected from the serial port.
+void pltExit(int ret)
+{
+	QCoreApplication::exit(ret);
+}
+}
+
+int allocationCount()
+{
+	return Allocations;
+}
+
+void initLogger(QsLogging::Level logLevel)
+{
+	QsLogging::Logger &logger = QsLogging::Logger::instance();
+	QsLogging::DestinationPtr debugDestination(
+			QsLogging::DestinationFactory::MakeDebugOutputDestination());
+	logger.addDestination(debugDestination);
+	logger.setIncludeTimestamp(false);
+	logger.setLoggingLevel(logLevel);
+}
+
+/*!
+ * Starts a private D-Bus daemon, so the benchmark does not interfere with
+ * other services. Returns the address of the new bus, or an empty string on
+ * failure.
+ */
+QString startDBus(QProcess &process)
+{
+	process.start("dbus-daemon", QStringList() << "--session" << "--nofork"
+				  << "--print-address");
+	if (!process.waitForStarted() || !process.waitForReadyRead()) {
+		QLOG_ERROR() << "Could not start dbus-daemon";
+		return QString();
+	}
+	return QString::fromLatin1(process.readLine()).trimmed();
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+
+	initLogger(QsLogging::WarnLevel);
+
+	bool expectVerbosity = false;
+	bool expectDBusAddress = false;
+	bool expectSlaveAddress = false;
+	bool expectLatency = false;
+	bool expectCycles = false;
+	bool expectTimeout = false;
+	QString dbusAddress;
+	int firstAddress = 1;
+	int lastAddress = 1;
+	int latency = 5;
+	int cycles = 20;
+	int timeout = 300;
+	QStringList args = app.arguments();
+	args.pop_front();
+	foreach (QString arg, args) {
+		if (expectVerbosity) {
+			QsLogging::Logger &logger = QsLogging::Logger::instance();
+			QsLogging::Level logLevel = static_cast<QsLogging::Level>(qBound(
+				static_cast<int>(QsLogging::TraceLevel),
+				arg.toInt(),
+				static_cast<int>(QsLogging::OffLevel)));
+			logger.setLoggingLevel(logLevel);
+			expectVerbosity = false;
+		} else if (expectDBusAddress) {
+			dbusAddress = arg;
+			expectDBusAddress = false;
+		} else if (expectSlaveAddress) {
+			QStringList range = arg.split('-');
+			firstAddress = range.first().toInt();
+			lastAddress = range.last().toInt();
+			if (range.size() > 2 || firstAddress < 1 || lastAddress > 247 ||
+				firstAddress > lastAddress) {
+				QLOG_ERROR() << "Invalid slave address range:" << arg;
+				exit(2);
+			}
+			expectSlaveAddress = false;
+		} else if (expectLatency) {
+			latency = qMax(0, arg.toInt());
+			expectLatency = false;
+		} else if (expectCycles) {
+			cycles = qMax(2, arg.toInt());
+			expectCycles = false;
+		} else if (expectTimeout) {
+			timeout = qMax(1, arg.toInt());
+			expectTimeout = false;
+		} else if (arg == "-h" || arg == "--help") {
+			QLOG_WARN() << app.arguments().first();
+			QLOG_WARN() << "\t-h, --help";
+			QLOG_WARN() << "\t Show this message.";
+			QLOG_WARN() << "\t-d level, --debug level";
+			QLOG_WARN() << "\t Set log level";
+			QLOG_WARN() << "\t-b address, --dbus address";
+			QLOG_WARN() << "\t dbus address or 'session'. By default a private bus";
+			QLOG_WARN() << "\t is started.";
+			QLOG_WARN() << "\t-a address, --address address";
+			QLOG_WARN() << "\t Slave address, or range of slave addresses (eg. 1-12).";
+			QLOG_WARN() << "\t-l ms, --latency ms";
+			QLOG_WARN() << "\t Response time of the simulated batteries.";
+			QLOG_WARN() << "\t-n count, --cycles count";
+			QLOG_WARN() << "\t Number of samples to collect. Default is 20.";
+			QLOG_WARN() << "\t-t s, --timeout s";
+			QLOG_WARN() << "\t Maximum duration of the benchmark. Default is 300.";
+			exit(1);
+		} else if (arg == "-d" || arg == "--debug") {
+			expectVerbosity = true;
+		} else if (arg == "-b" || arg == "--dbus") {
+			expectDBusAddress = true;
+		} else if (arg == "-a" || arg == "--address") {
+			expectSlaveAddress = true;
+		} else if (arg == "-l" || arg == "--latency") {
+			expectLatency = true;
+		} else if (arg == "-n" || arg == "--cycles") {
+			expectCycles = true;
+		} else if (arg == "-t" || arg == "--timeout") {
+			expectTimeout = true;
+		}
+	}
+
+	QProcess dbusDaemon;
+	if (dbusAddress.isEmpty()) {
+		dbusAddress = startDBus(dbusDaemon);
+		if (dbusAddress.isEmpty())
+			exit(1);
+	}
+	VBusItems::setDBusAddress(dbusAddress);
+
+	ZbmSimulator simulator;
+	simulator.setSlaveRange(firstAddress, lastAddress);
+	simulator.setLatency(latency, 0);
+	if (!simulator.open())
+		exit(1);
+
+	QDBusConnection connection = dbusAddress == "session" ?
+				QDBusConnection::sessionBus() :
+				QDBusConnection::connectToBus(dbusAddress, "benchmark");
+	Benchmark benchmark(&simulator, connection, cycles, timeout);
+	app.connect(&benchmark, SIGNAL(finished()), &app, SLOT(quit()));
+
+	int result = 0;
+	{
+		DBusRedflow redflow(QStringList(simulator.portName()), firstAddress,
+							lastAddress);
+		result = app.exec();
+	}
+	benchmark.printReport();
+	if (dbusDaemon.state() != QProcess::NotRunning) {
+		dbusDaemon.terminate();
+		dbusDaemon.waitForFinished();
+	}
+	return result == 0 && benchmark.completed() ? 0 : 1;
+}
@@ -0,0 +1,22 @@
+# Micro benchmark of the CRC16 computation: compares the byte wise table
+# lookup with the sliced computation used for larger blocks.
+
+QT += core
+QT -= gui
+
+TARGET = crc-benchmark
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += \
+    ../../src
+
+SOURCES += \
+    main.cpp \
+    ../../src/crc16.cpp
+
+HEADERS += \
+    ../../src/crc16.h \
+    ../../src/defines.h
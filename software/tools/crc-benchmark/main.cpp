@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "crc16.h"
+
+// Frame sizes: read request, short and long register replies, and the
+// largest RTU frame.
+static const int FrameSizes[] = { 8, 13, 25, 41, 69, 128, 256 };
+static const int FrameSizeCount = sizeof(FrameSizes) / sizeof(FrameSizes[0]);
+static const int MaxFrameSize = 256;
+
+/*!
+ * Returns a monotonic time stamp in nanoseconds.
+ */
+static qint64 now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * Q_INT64_C(1000000000) + ts.tv_nsec;
+}
+
+// Table for the byte wise computation. It is built here, rather than using
+// `Crc16::add(uint8_t)`, so the byte loop can be inlined like the original
+// implementation of `Crc16::add(const uint8_t *, int)`.
+static uint16_t Table[256];
+
+static void initTable()
+{
+	for (int i=0; i<256; ++i) {
+		uint16_t v = i;
+		for (int k=0; k<8; ++k)
+			v = (v & 1) != 0 ? (v >> 1) ^ 0xA001 : v >> 1;
+		Table[i] = v;
+	}
+}
+
+static uint16_t byteWise(const uint8_t *bytes, int length)
+{
+	uint16_t crc = 0xFFFF;
+	for (int i=0; i<length; ++i)
+		crc = (crc >> 8) ^ Table[(crc ^ bytes[i]) & 0xFF];
+	// Same byte order as `Crc16::getValue`
+	return (crc << 8) | (crc >> 8);
+}
+
+static uint16_t sliced(const uint8_t *bytes, int length)
+{
+	return Crc16::getValue(bytes, length);
+}
+
+/*!
+ * Returns the time per frame in nanoseconds. `checksum` receives the sum of
+ * all results, so the compiler cannot drop the computation.
+ */
+static double measure(uint16_t (*f)(const uint8_t *, int),
+					  const uint8_t *frames, int length, int iterations,
+					  uint16_t &checksum)
+{
+	// Rotate over a few frames, so the result does not depend on the data
+	// of a single frame.
+	qint64 start = now();
+	for (int i=0; i<iterations; ++i)
+		checksum += f(frames + (i & 15), length);
+	return static_cast<double>(now() - start) / iterations;
+}
+
+int main(int argc, char *argv[])
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+	if (iterations <= 0) {
+		fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+		return 1;
+	}
+	initTable();
+	uint8_t frames[MaxFrameSize + 16];
+	srand(1);
+	for (int i=0; i<MaxFrameSize + 16; ++i)
+		frames[i] = rand() & 0xFF;
+	// Both implementations must agree before their speed is compared.
+	for (int length=0; length<=MaxFrameSize; ++length) {
+		if (byteWise(frames, length) != sliced(frames, length)) {
+			fprintf(stderr, "CRC mismatch for %d bytes\n", length);
+			return 1;
+		}
+	}
+	uint16_t checksum = 0;
+	printf("[");
+	for (int i=0; i<FrameSizeCount; ++i) {
+		int length = FrameSizes[i];
+		// Warm up the caches and the tables
+		measure(byteWise, frames, length, iterations / 10, checksum);
+		measure(sliced, frames, length, iterations / 10, checksum);
+		double b = measure(byteWise, frames, length, iterations, checksum);
+		double s = measure(sliced, frames, length, iterations, checksum);
+		printf("%s\n {\"bytes\": %d, \"bytewise_ns\": %.1f, "
+			   "\"sliced_ns\": %.1f, \"speedup\": %.2f}",
+			   i == 0 ? "" : ",", length, b, s, b / s);
+	}
+	printf("\n]\n");
+	fprintf(stderr, "checksum %04x\n", checksum);
+	return 0;
+}
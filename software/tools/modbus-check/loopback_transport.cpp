@@ -0,0 +1,57 @@
+#include "loopback_transport.h"
+
+LoopbackTransport::LoopbackTransport(Framing framing, int maxInFlight,
+									 QObject *parent):
+	ModbusTransport(parent),
+	mFraming(framing),
+	mMaxInFlight(maxInFlight),
+	mChunkSize(0)
+{
+}
+
+ModbusTransport::Framing LoopbackTransport::framing() const
+{
+	return mFraming;
+}
+
+int LoopbackTransport::maxInFlight() const
+{
+	return mMaxInFlight;
+}
+
+void LoopbackTransport::send(const quint8 *data, int length)
+{
+	mRequests.append(QByteArray(reinterpret_cast<const char *>(data), length));
+	int index = mRequests.size() - 1;
+	if (index >= mScript.size() || mScript[index].isEmpty())
+		return;
+	mPending.append(mScript[index]);
+	// `ModbusRtu` does not expect a reply before the request has been sent.
+	QMetaObject::invokeMethod(this, "deliver", Qt::QueuedConnection);
+}
+
+void LoopbackTransport::addReply(const QByteArray &data)
+{
+	mScript.append(data);
+}
+
+void LoopbackTransport::setChunkSize(int size)
+{
+	mChunkSize = size;
+}
+
+const QList<QByteArray> &LoopbackTransport::requests() const
+{
+	return mRequests;
+}
+
+void LoopbackTransport::deliver()
+{
+	if (mPending.isEmpty())
+		return;
+	QByteArray data = mPending.takeFirst();
+	const quint8 *p = reinterpret_cast<const quint8 *>(data.constData());
+	int chunk = mChunkSize > 0 ? mChunkSize : data.size();
+	for (int offset=0; offset<data.size(); offset += chunk)
+		emit dataReceived(p + offset, qMin(chunk, data.size() - offset));
+}
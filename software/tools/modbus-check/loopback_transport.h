@@ -0,0 +1,60 @@
+#ifndef LOOPBACK_TRANSPORT_H
+#define LOOPBACK_TRANSPORT_H
+
+#include <QByteArray>
+#include <QList>
+#include "modbus_transport.h"
+
+/*!
+ * In-memory transport which answers requests with scripted replies, so the
+ * framing code of `ModbusRtu` can be checked without a bus.
+ *
+ * The n-th request sent is answered with the n-th entry of the script. The
+ * entry may contain anything: a valid reply, garbage, several replies, or
+ * nothing at all (so the request times out). The data is delivered from the
+ * event loop, never from within `send`, in chunks of `chunkSize` bytes.
+ */
+class LoopbackTransport : public ModbusTransport
+{
+	Q_OBJECT
+public:
+	LoopbackTransport(Framing framing, int maxInFlight = 1,
+					  QObject *parent = 0);
+
+	virtual Framing framing() const;
+
+	virtual int maxInFlight() const;
+
+	virtual void send(const quint8 *data, int length);
+
+	/*!
+	 * Appends `data` to the script. It will be delivered after the next
+	 * request without an entry.
+	 */
+	void addReply(const QByteArray &data);
+
+	/*!
+	 * Sets the number of bytes passed per `dataReceived` signal. 0 (the
+	 * default) delivers each reply at once.
+	 */
+	void setChunkSize(int size);
+
+	/*!
+	 * Returns all requests sent so far.
+	 */
+	const QList<QByteArray> &requests() const;
+
+private slots:
+	void deliver();
+
+private:
+	Framing mFraming;
+	int mMaxInFlight;
+	int mChunkSize;
+	QList<QByteArray> mScript;
+	QList<QByteArray> mRequests;
+	// Data waiting to be delivered
+	QList<QByteArray> mPending;
+};
+
+#endif // LOOPBACK_TRANSPORT_H
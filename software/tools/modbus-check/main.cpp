@@ -0,0 +1,9 @@
+#include <QCoreApplication>
+#include "modbus_check.h"
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	ModbusCheck check;
+	return check.run() == 0 ? 0 : 1;
+}
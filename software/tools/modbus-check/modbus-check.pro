@@ -0,0 +1,32 @@
+# Checks the Modbus RTU and Modbus TCP framing of `ModbusRtu` against scripted
+# replies from an in-memory transport. Exits with 1 if any check fails.
+
+QT += core
+QT -= gui
+
+TARGET = modbus-check
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += \
+    ../../src
+
+SOURCES += \
+    main.cpp \
+    loopback_transport.cpp \
+    modbus_check.cpp \
+    ../../src/modbus_rtu.cpp \
+    ../../src/modbus_counters.cpp \
+    ../../src/modbus_transport.cpp \
+    ../../src/crc16.cpp
+
+HEADERS += \
+    loopback_transport.h \
+    modbus_check.h \
+    ../../src/modbus_rtu.h \
+    ../../src/modbus_counters.h \
+    ../../src/modbus_transport.h \
+    ../../src/crc16.h \
+    ../../src/defines.h
@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <QCoreApplication>
+#include <QTimer>
+#include "defines.h"
+#include "loopback_transport.h"
+#include "modbus_check.h"
+#include "modbus_rtu.h"
+
+static const int MaxWait = 1000;
+
+/*!
+ * Returns `adu` (slave address and PDU, given as hex string) followed by its
+ * CRC.
+ */
+static QByteArray rtuFrame(const char *adu)
+{
+	QByteArray frame = QByteArray::fromHex(adu);
+	quint16 crc = Crc16::getValue(frame);
+	frame.append(static_cast<char>(msb(crc)));
+	frame.append(static_cast<char>(lsb(crc)));
+	return frame;
+}
+
+/*!
+ * Returns the Modbus TCP frame with transaction ID `id`, unit ID `unit`, and
+ * `pdu` (given as hex string).
+ */
+static QByteArray mbapFrame(quint16 id, quint8 unit, const char *pdu)
+{
+	QByteArray data = QByteArray::fromHex(pdu);
+	QByteArray frame;
+	frame.append(static_cast<char>(msb(id)));
+	frame.append(static_cast<char>(lsb(id)));
+	frame.append(static_cast<char>(0));
+	frame.append(static_cast<char>(0));
+	frame.append(static_cast<char>(msb(data.size() + 1)));
+	frame.append(static_cast<char>(lsb(data.size() + 1)));
+	frame.append(static_cast<char>(unit));
+	frame.append(data);
+	return frame;
+}
+
+ModbusCheck::ModbusCheck(QObject *parent):
+	QObject(parent),
+	mFailures(0)
+{
+}
+
+int ModbusCheck::run()
+{
+	mFailures = 0;
+	checkRtuReply();
+	checkRtuResync();
+	checkRtuCrcError();
+	checkRtuException();
+	checkRtuTimeout();
+	checkMbapOutOfOrder();
+	checkMbapStaleReply();
+	return mFailures;
+}
+
+void ModbusCheck::onReadCompleted(int function, quint8 slaveAddress,
+								  const RegisterSpan &values)
+{
+	Q_UNUSED(function)
+	QString s = QString("read %1").arg(static_cast<int>(slaveAddress));
+	for (int i=0; i<values.size(); ++i)
+		s += QString(" %1").arg(values[i], 4, 16, QChar('0'));
+	mEvents.append(s);
+}
+
+void ModbusCheck::onWriteCompleted(int function, quint8 slaveAddress,
+								   quint16 address, quint16 value)
+{
+	Q_UNUSED(function)
+	mEvents.append(QString("write %1 %2 %3").
+				   arg(static_cast<int>(slaveAddress)).
+				   arg(address, 4, 16, QChar('0')).
+				   arg(value, 4, 16, QChar('0')));
+}
+
+void ModbusCheck::onErrorReceived(int errorType, quint8 slaveAddress,
+								  int exception)
+{
+	const char *name = "unsupported";
+	switch (errorType) {
+	case ModbusRtu::CrcError:
+		name = "crc";
+		break;
+	case ModbusRtu::Timeout:
+		name = "timeout";
+		break;
+	case ModbusRtu::Exception:
+		name = "exception";
+		break;
+	default:
+		break;
+	}
+	mEvents.append(QString("%1 %2 %3").arg(name).
+				   arg(static_cast<int>(slaveAddress)).
+				   arg(exception));
+}
+
+void ModbusCheck::checkRtuReply()
+{
+	LoopbackTransport *transport =
+			new LoopbackTransport(ModbusTransport::RtuFraming);
+	transport->addReply(rtuFrame("0103021234"));
+	ModbusRtu *modbus = createModbus(transport);
+	modbus->readRegisters(ModbusRtu::ReadHoldingRegisters, 1, 0x9013, 1);
+	waitForEvents(1);
+	mEvents.prepend(QString("sent %1").
+					arg(QString(transport->requests().value(0).toHex())));
+	verify("RTU reply", QStringList() <<
+		   QString("sent %1").arg(QString(rtuFrame("010390130001").toHex())) <<
+		   "read 1 1234");
+	delete modbus;
+}
+
+void ModbusCheck::checkRtuResync()
+{
+	// The garbage contains the start of an exception reply from slave 1,
+	// which must be skipped because its CRC is invalid. The data arrives in
+	// small chunks, so the parser has to wait for the rest of each frame.
+	LoopbackTransport *transport =
+			new LoopbackTransport(ModbusTransport::RtuFraming);
+	transport->addReply(QByteArray::fromHex("00ff0183") +
+						rtuFrame("0103021234"));
+	transport->setChunkSize(3);
+	ModbusRtu *modbus = createModbus(transport);
+	modbus->readRegisters(ModbusRtu::ReadHoldingRegisters, 1, 0x9013, 1);
+	waitForEvents(1);
+	verify("RTU resync", QStringList() << "read 1 1234");
+	delete modbus;
+}
+
+void ModbusCheck::checkRtuCrcError()
+{
+	QByteArray reply = rtuFrame("0103021234");
+	char last = reply.at(reply.size() - 1);
+	reply[reply.size() - 1] = static_cast<char>(last ^ 0x01);
+	LoopbackTransport *transport =
+			new LoopbackTransport(ModbusTransport::RtuFraming);
+	transport->addReply(reply);
+	ModbusRtu *modbus = createModbus(transport);
+	modbus->readRegisters(ModbusRtu::ReadHoldingRegisters, 1, 0x9013, 1);
+	waitForEvents(1);
+	verify("RTU CRC error", QStringList() << "crc 1 0");
+	delete modbus;
+}
+
+void ModbusCheck::checkRtuException()
+{
+	LoopbackTransport *transport =
+			new LoopbackTransport(ModbusTransport::RtuFraming);
+	transport->addReply(rtuFrame("018302"));
+	transport->addReply(rtuFrame("010611010001"));
+	ModbusRtu *modbus = createModbus(transport);
+	modbus->readRegisters(ModbusRtu::ReadHoldingRegisters, 1, 0x1101, 2);
+	waitForEvents(1);
+	modbus->writeRegister(ModbusRtu::WriteSingleRegister, 1, 0x1101, 1);
+	waitForEvents(2);
+	verify("RTU exception", QStringList() << "exception 1 2" <<
+		   "write 1 1101 0001");
+	delete modbus;
+}
+
+void ModbusCheck::checkRtuTimeout()
+{
+	// The first request is not answered. The next request must not be
+	// affected by the timeout.
+	LoopbackTransport *transport =
+			new LoopbackTransport(ModbusTransport::RtuFraming);
+	transport->addReply(QByteArray());
+	transport->addReply(rtuFrame("0103021234"));
+	ModbusRtu *modbus = createModbus(transport);
+	modbus->readRegisters(ModbusRtu::ReadHoldingRegisters, 1, 0x9013, 1);
+	waitForEvents(1);
+	modbus->readRegisters(ModbusRtu::ReadHoldingRegisters, 1, 0x9013, 1);
+	waitForEvents(2);
+	verify("RTU timeout", QStringList() << "timeout 1 0" << "read 1 1234");
+	delete modbus;
+}
+
+void ModbusCheck::checkMbapOutOfOrder()
+{
+	// Two requests are pipelined, and answered in reverse order.
+	LoopbackTransport *transport =
+			new LoopbackTransport(ModbusTransport::MbapFraming, 2);
+	transport->addReply(QByteArray());
+	transport->addReply(mbapFrame(1, 2, "03020002") +
+						mbapFrame(0, 1, "03020001"));
+	ModbusRtu *modbus = createModbus(transport);
+	modbus->readRegisters(ModbusRtu::ReadHoldingRegisters, 1, 0x9013, 1);
+	modbus->readRegisters(ModbusRtu::ReadHoldingRegisters, 2, 0x9013, 1);
+	waitForEvents(2);
+	verify("MBAP out of order", QStringList() << "read 2 0002" <<
+		   "read 1 0001");
+	delete modbus;
+}
+
+void ModbusCheck::checkMbapStaleReply()
+{
+	// The reply to the first request arrives after it has timed out, just
+	// before the reply to the second request. A reply with an unknown
+	// transaction ID is received as well. Both must be dropped.
+	LoopbackTransport *transport =
+			new LoopbackTransport(ModbusTransport::MbapFraming);
+	transport->addReply(QByteArray());
+	transport->addReply(mbapFrame(0, 1, "03020bad") +
+						mbapFrame(7, 1, "03020bad") +
+						mbapFrame(1, 1, "03020001"));
+	transport->setChunkSize(5);
+	ModbusRtu *modbus = createModbus(transport);
+	modbus->readRegisters(ModbusRtu::ReadHoldingRegisters, 1, 0x9013, 1);
+	waitForEvents(1);
+	modbus->readRegisters(ModbusRtu::ReadHoldingRegisters, 1, 0x9013, 1);
+	waitForEvents(2);
+	verify("MBAP stale reply", QStringList() << "timeout 1 0" <<
+		   "read 1 0001");
+	delete modbus;
+}
+
+ModbusRtu *ModbusCheck::createModbus(LoopbackTransport *transport)
+{
+	mEvents.clear();
+	ModbusRtu *modbus = new ModbusRtu(transport);
+	modbus->setTimeoutBounds(10, 100);
+	modbus->setProbeTimeout(50);
+	connect(modbus, SIGNAL(readCompleted(int, quint8, const RegisterSpan &)),
+			this, SLOT(onReadCompleted(int, quint8, const RegisterSpan &)));
+	connect(modbus, SIGNAL(writeCompleted(int, quint8, quint16, quint16)),
+			this, SLOT(onWriteCompleted(int, quint8, quint16, quint16)));
+	connect(modbus, SIGNAL(errorReceived(int, quint8, int)),
+			this, SLOT(onErrorReceived(int, quint8, int)));
+	return modbus;
+}
+
+void ModbusCheck::waitForEvents(int count)
+{
+	// The guard makes sure the event loop wakes up even if nothing else
+	// happens.
+	QTimer guard;
+	guard.setSingleShot(true);
+	guard.start(MaxWait);
+	while (mEvents.size() < count && guard.isActive())
+		QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+}
+
+void ModbusCheck::verify(const char *name, const QStringList &expected)
+{
+	// Signals emitted after the last expected one are reported as well.
+	QCoreApplication::processEvents();
+	if (mEvents == expected) {
+		printf("PASS %s\n", name);
+		return;
+	}
+	++mFailures;
+	printf("FAIL %s\n  expected: %s\n  received: %s\n", name,
+		   qPrintable(expected.join(", ")), qPrintable(mEvents.join(", ")));
+}
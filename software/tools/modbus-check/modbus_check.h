@@ -0,0 +1,74 @@
+#ifndef MODBUS_CHECK_H
+#define MODBUS_CHECK_H
+
+#include <QObject>
+#include <QStringList>
+
+class LoopbackTransport;
+class ModbusRtu;
+class RegisterSpan;
+
+/*!
+ * Checks the framing code of `ModbusRtu` against scripted replies from a
+ * `LoopbackTransport`: resynchronization on garbage, CRC errors, exceptions
+ * and timeouts with Modbus RTU, and matching of replies by transaction ID
+ * with Modbus TCP.
+ *
+ * Each check records the signals emitted by `ModbusRtu` as short strings (eg.
+ * "read 1 1234" or "timeout 1 0") and compares them with the expected list.
+ */
+class ModbusCheck : public QObject
+{
+	Q_OBJECT
+public:
+	ModbusCheck(QObject *parent = 0);
+
+	/*!
+	 * Runs all checks, and prints the result of each check to stdout.
+	 * Returns the number of failed checks.
+	 */
+	int run();
+
+private slots:
+	void onReadCompleted(int function, quint8 slaveAddress,
+						 const RegisterSpan &values);
+
+	void onWriteCompleted(int function, quint8 slaveAddress, quint16 address,
+						  quint16 value);
+
+	void onErrorReceived(int errorType, quint8 slaveAddress, int exception);
+
+private:
+	void checkRtuReply();
+
+	void checkRtuResync();
+
+	void checkRtuCrcError();
+
+	void checkRtuException();
+
+	void checkRtuTimeout();
+
+	void checkMbapOutOfOrder();
+
+	void checkMbapStaleReply();
+
+	/*!
+	 * Creates a `ModbusRtu` with short timeouts, which takes ownership of
+	 * `transport`.
+	 */
+	ModbusRtu *createModbus(LoopbackTransport *transport);
+
+	/*!
+	 * Runs the event loop until `count` signals have been recorded, or a
+	 * second has passed.
+	 */
+	void waitForEvents(int count);
+
+	void verify(const char *name, const QStringList &expected);
+
+	QStringList mEvents;
+	int mFailures;
+};
+
+#endif // MODBUS_CHECK_H
@@ -0,0 +1,117 @@
+#include <unistd.h>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QFile>
+#include <QsLog.h>
+#include <QStringList>
+#include "zbm_simulator.h"
+
+void initLogger(QsLogging::Level logLevel)
+{
+	QsLogging::Logger &logger = QsLogging::Logger::instance();
+	QsLogging::DestinationPtr debugDestination(
+			QsLogging::DestinationFactory::MakeDebugOutputDestination());
+	logger.addDestination(debugDestination);
+	logger.setIncludeTimestamp(false);
+	logger.setLoggingLevel(logLevel);
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+
+	initLogger(QsLogging::InfoLevel);
+	qsrand(QDateTime::currentDateTime().toTime_t());
+
+	bool expectSlaveAddress = false;
+	bool expectLatency = false;
+	bool expectJitter = false;
+	bool expectCrcErrorRate = false;
+	bool expectLink = false;
+	int firstAddress = 1;
+	int lastAddress = 1;
+	int latency = 5;
+	int jitter = 0;
+	double crcErrorRate = 0;
+	bool strict = false;
+	QString link;
+	QStringList args = app.arguments();
+	args.pop_front();
+	foreach (QString arg, args) {
+		if (expectSlaveAddress) {
+			QStringList range = arg.split('-');
+			firstAddress = range.first().toInt();
+			lastAddress = range.last().toInt();
+			if (range.size() > 2 || firstAddress < 1 || lastAddress > 247 ||
+				firstAddress > lastAddress) {
+				QLOG_ERROR() << "Invalid slave address range:" << arg;
+				exit(2);
+			}
+			expectSlaveAddress = false;
+		} else if (expectLatency) {
+			latency = qMax(0, arg.toInt());
+			expectLatency = false;
+		} else if (expectJitter) {
+			jitter = qMax(0, arg.toInt());
+			expectJitter = false;
+		} else if (expectCrcErrorRate) {
+			crcErrorRate = qBound(0.0, arg.toDouble(), 1.0);
+			expectCrcErrorRate = false;
+		} else if (expectLink) {
+			link = arg;
+			expectLink = false;
+		} else if (arg == "-h" || arg == "--help") {
+			QLOG_INFO() << app.arguments().first();
+			QLOG_INFO() << "\t-h, --help";
+			QLOG_INFO() << "\t Show this message.";
+			QLOG_INFO() << "\t-a address, --address address";
+			QLOG_INFO() << "\t Slave address, or range of slave addresses (eg. 1-12)";
+			QLOG_INFO() << "\t of the simulated batteries. Default is 1.";
+			QLOG_INFO() << "\t-l ms, --latency ms";
+			QLOG_INFO() << "\t Response time of the batteries. Default is 5.";
+			QLOG_INFO() << "\t-j ms, --jitter ms";
+			QLOG_INFO() << "\t Maximum random deviation of the response time.";
+			QLOG_INFO() << "\t-c rate, --crc-errors rate";
+			QLOG_INFO() << "\t Fraction of replies sent with a CRC error (eg. 0.01).";
+			QLOG_INFO() << "\t--strict";
+			QLOG_INFO() << "\t Reject reads of undocumented registers.";
+			QLOG_INFO() << "\t--link path";
+			QLOG_INFO() << "\t Create a symbolic link to the pseudo terminal.";
+			exit(1);
+		} else if (arg == "-a" || arg == "--address") {
+			expectSlaveAddress = true;
+		} else if (arg == "-l" || arg == "--latency") {
+			expectLatency = true;
+		} else if (arg == "-j" || arg == "--jitter") {
+			expectJitter = true;
+		} else if (arg == "-c" || arg == "--crc-errors") {
+			expectCrcErrorRate = true;
+		} else if (arg == "--strict") {
+			strict = true;
+		} else if (arg == "--link") {
+			expectLink = true;
+		}
+	}
+
+	ZbmSimulator simulator;
+	simulator.setSlaveRange(firstAddress, lastAddress);
+	simulator.setLatency(latency, jitter);
+	simulator.setCrcErrorRate(crcErrorRate);
+	simulator.setStrict(strict);
+	if (!simulator.open())
+		exit(1);
+	QString portName = simulator.portName();
+	if (!link.isEmpty()) {
+		QFile::remove(link);
+		if (symlink(portName.toLocal8Bit().constData(),
+					link.toLocal8Bit().constData()) != 0) {
+			QLOG_ERROR() << "Could not create link" << link;
+			exit(1);
+		}
+		portName = link;
+	}
+	QLOG_INFO() << "Simulating batteries" << firstAddress << "to" << lastAddress
+				<< "on" << portName;
+
+	return app.exec();
+}
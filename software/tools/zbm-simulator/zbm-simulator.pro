@@ -0,0 +1,27 @@
+# Simulator of one or more Redflow ZBM batteries on a Modbus RTU bus. The bus
+# is a pseudo terminal, so dbus-redflow can be tested without hardware.
+
+QT += core
+QT -= gui
+
+TARGET = zbm-simulator
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+include(../../ext/qslog/QsLog.pri)
+
+INCLUDEPATH += \
+    ../../ext/qslog \
+    ../../src
+
+SOURCES += \
+    main.cpp \
+    zbm_simulator.cpp \
+    ../../src/crc16.cpp
+
+HEADERS += \
+    zbm_simulator.h \
+    ../../src/crc16.h \
+    ../../src/defines.h
@@ -0,0 +1,339 @@
+#include <cmath>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <QsLog.h>
+#include <QSocketNotifier>
+#include <QTimer>
+#include "crc16.h"
+#include "defines.h"
+#include "zbm_simulator.h"
+
+static const int UpdateInterval = 1000;
+// Number of updates between 2 log lines with statistics
+static const int StatisticsInterval = 60;
+
+// Function codes and exceptions used by the simulator
+enum {
+	ReadHoldingRegisters = 3,
+	ReadInputRegisters = 4,
+	WriteSingleRegister = 6,
+	IllegalFunction = 1,
+	IllegalDataAddress = 2,
+	IllegalDataValue = 3
+};
+
+// Register offsets within the telemetry block (0x9000)
+enum {
+	RegStsRegSummary = 0x01,
+	RegStsRegWarning = 0x04,
+	RegOperationalMode = 0x08,
+	RegSoc = 0x11,
+	RegSocAmpHrs = 0x12,
+	RegBattVolts = 0x13,
+	RegBattAmps = 0x14,
+	RegBattTemp = 0x15,
+	RegAirTemp = 0x16,
+	RegHealth = 0x17,
+	RegBussVolts = 0x18,
+	RegState = 0x19,
+	RegDeviceAddress = 0x30,
+	RegClearStatusRegisterFlags = 0x31,
+	RegSelfMaintenanceCycle = 0x35
+};
+
+/*!
+ * Returns true if `reg` is one of the registers documented in the header.
+ */
+static bool isKnownRegister(int reg)
+{
+	return (reg >= 0x0003 && reg <= 0x0006) || reg == 0x000D ||
+			reg == 0x1101 || reg == 0x1102 ||
+			(reg >= 0x9001 && reg <= 0x9004) || reg == 0x9008 ||
+			(reg >= 0x9011 && reg <= 0x9019) ||
+			(reg >= 0x9030 && reg <= 0x9035);
+}
+
+ZbmSimulator::ZbmSimulator(QObject *parent):
+	QObject(parent),
+	mFd(-1),
+	mSlaveFd(-1),
+	mNotifier(0),
+	mReplyTimer(new QTimer(this)),
+	mUpdateTimer(new QTimer(this)),
+	mLatency(5),
+	mJitter(0),
+	mCrcErrorRate(0),
+	mStrict(false),
+	mRxLength(0),
+	mTxLength(0),
+	mRequests(0),
+	mCrcErrors(0),
+	mUpdates(0)
+{
+	mReplyTimer->setSingleShot(true);
+	connect(mReplyTimer, SIGNAL(timeout()), this, SLOT(onReplyTimer()));
+	mUpdateTimer->setInterval(UpdateInterval);
+	connect(mUpdateTimer, SIGNAL(timeout()), this, SLOT(onUpdateTimer()));
+	mUptime.start();
+	setSlaveRange(1, 1);
+}
+
+ZbmSimulator::~ZbmSimulator()
+{
+	if (mSlaveFd != -1)
+		close(mSlaveFd);
+	if (mFd != -1)
+		close(mFd);
+}
+
+bool ZbmSimulator::open()
+{
+	mFd = posix_openpt(O_RDWR | O_NOCTTY);
+	if (mFd == -1 || grantpt(mFd) != 0 || unlockpt(mFd) != 0) {
+		QLOG_ERROR() << "Could not create pseudo terminal:" << strerror(errno);
+		return false;
+	}
+	mPortName = ptsname(mFd);
+	mSlaveFd = ::open(ptsname(mFd), O_RDWR | O_NOCTTY);
+	// No echo, and no translation of line endings.
+	struct termios tio;
+	tcgetattr(mFd, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(mFd, TCSANOW, &tio);
+	fcntl(mFd, F_SETFL, fcntl(mFd, F_GETFL) | O_NONBLOCK);
+	mNotifier = new QSocketNotifier(mFd, QSocketNotifier::Read, this);
+	connect(mNotifier, SIGNAL(activated(int)), this, SLOT(onReadyRead()));
+	onUpdateTimer();
+	mUpdateTimer->start();
+	return true;
+}
+
+QString ZbmSimulator::portName() const
+{
+	return mPortName;
+}
+
+void ZbmSimulator::setSlaveRange(int firstAddress, int lastAddress)
+{
+	Q_ASSERT(firstAddress >= 1 && firstAddress <= lastAddress &&
+			 lastAddress <= 247);
+	mBatteries.resize(lastAddress - firstAddress + 1);
+	for (int i=0; i<mBatteries.size(); ++i)
+		initBattery(mBatteries[i], firstAddress + i);
+}
+
+void ZbmSimulator::setLatency(int latency, int jitter)
+{
+	mLatency = latency;
+	mJitter = jitter;
+}
+
+void ZbmSimulator::setCrcErrorRate(double rate)
+{
+	mCrcErrorRate = rate;
+}
+
+void ZbmSimulator::setStrict(bool strict)
+{
+	mStrict = strict;
+}
+
+bool ZbmSimulator::setRegister(int address, int reg, quint16 value)
+{
+	Battery *battery = findBattery(address);
+	if (battery == 0)
+		return false;
+	quint16 *r = registerAt(*battery, reg);
+	if (r == 0)
+		return false;
+	*r = value;
+	return true;
+}
+
+void ZbmSimulator::onReadyRead()
+{
+	for (;;) {
+		if (mRxLength == MaxFrameSize) {
+			// Garbage. Frames are much shorter.
+			mRxLength = 0;
+		}
+		int n = read(mFd, mRxFrame + mRxLength, MaxFrameSize - mRxLength);
+		if (n <= 0)
+			break;
+		mRxLength += n;
+	}
+	processFrames();
+}
+
+void ZbmSimulator::onReplyTimer()
+{
+	if (write(mFd, mTxFrame, mTxLength) != mTxLength)
+		QLOG_WARN() << "Could not send reply:" << strerror(errno);
+	mTxLength = 0;
+	emit replySent();
+	// Requests received while the reply was pending
+	processFrames();
+}
+
+void ZbmSimulator::onUpdateTimer()
+{
+	// Slowly changing values, with a different phase for each battery.
+	double t = mUptime.elapsed() / 1000.0;
+	for (int i=0; i<mBatteries.size(); ++i) {
+		Battery &b = mBatteries[i];
+		double phase = t / 600.0 + b.address;
+		quint16 *r = b.telemetry;
+		r[RegSoc] = static_cast<quint16>(50 + 40 * sin(phase));
+		r[RegSocAmpHrs] = static_cast<quint16>(r[RegSoc] * 3);
+		// Units of 0.1 V, 0.1 A, and 0.1 degrees celsius
+		r[RegBattVolts] = static_cast<quint16>(520 + 30 * sin(phase));
+		r[RegBattAmps] = static_cast<quint16>(static_cast<qint16>(
+			300 * cos(phase)));
+		r[RegBattTemp] = static_cast<quint16>(250 + 50 * sin(phase / 3));
+		r[RegAirTemp] = static_cast<quint16>(220 + 20 * sin(phase / 5));
+		r[RegBussVolts] = r[RegBattVolts] + 5;
+	}
+	++mUpdates;
+	if (mUpdates % StatisticsInterval == 0) {
+		QLOG_INFO() << "Requests handled:" << mRequests
+					<< "replies with CRC errors:" << mCrcErrors;
+	}
+}
+
+void ZbmSimulator::initBattery(Battery &battery, int address)
+{
+	battery.address = address;
+	memset(battery.info, 0, sizeof(battery.info));
+	memset(battery.setup, 0, sizeof(battery.setup));
+	memset(battery.telemetry, 0, sizeof(battery.telemetry));
+	battery.info[0x03] = 0x0102; // Firmware version
+	battery.info[0x05] = 0; // Serial number (2 registers)
+	battery.info[0x06] = 1000 + address;
+	battery.info[0x0D] = 0x5A42; // Device ID
+	battery.telemetry[RegOperationalMode] = 1;
+	battery.telemetry[RegHealth] = 100;
+	battery.telemetry[RegState] = 1;
+	battery.telemetry[RegDeviceAddress] = address;
+}
+
+void ZbmSimulator::processFrames()
+{
+	// Only one reply can be sent at a time (half duplex bus).
+	while (mRxLength > 0 && !mReplyTimer->isActive()) {
+		int length = handleRequest();
+		if (length == 0)
+			return;
+		if (length < 0)
+			length = 1; // Search for the start of the next request.
+		mRxLength -= length;
+		memmove(mRxFrame, mRxFrame + length, mRxLength);
+	}
+}
+
+int ZbmSimulator::handleRequest()
+{
+	if (mRxLength < 2)
+		return 0;
+	quint8 function = mRxFrame[1];
+	if (function != ReadHoldingRegisters && function != ReadInputRegisters &&
+		function != WriteSingleRegister)
+		return -1;
+	// All supported requests are 8 bytes long.
+	const int length = 8;
+	if (mRxLength < length)
+		return 0;
+	quint16 crc = toUInt16(mRxFrame[6], mRxFrame[7]);
+	if (crc != Crc16::getValue(mRxFrame, length - 2))
+		return -1;
+	++mRequests;
+	Battery *battery = findBattery(mRxFrame[0]);
+	if (battery == 0)
+		return length; // Request for another slave
+	quint16 reg = toUInt16(mRxFrame[2], mRxFrame[3]);
+	quint16 value = toUInt16(mRxFrame[4], mRxFrame[5]);
+	emit requestReceived(battery->address, function, reg,
+						 function == WriteSingleRegister ? 1 : value);
+	quint8 pdu[MaxFrameSize];
+	if (function == WriteSingleRegister) {
+		quint16 *r = registerAt(*battery, reg);
+		if (r == 0) {
+			pdu[0] = function | 0x80;
+			pdu[1] = IllegalDataAddress;
+			queueReply(pdu, 2, battery->address);
+			return length;
+		}
+		*r = value;
+		if (reg == TelemetryBase + RegClearStatusRegisterFlags) {
+			for (int i=RegStsRegSummary; i<=RegStsRegWarning; ++i)
+				battery->telemetry[i] = 0;
+		}
+		// The reply of a write is an echo of the request.
+		queueReply(mRxFrame + 1, 5, battery->address);
+		return length;
+	}
+	if (value == 0 || value > 125) {
+		pdu[0] = function | 0x80;
+		pdu[1] = IllegalDataValue;
+		queueReply(pdu, 2, battery->address);
+		return length;
+	}
+	pdu[0] = function;
+	pdu[1] = 2 * value;
+	for (int i=0; i<value; ++i) {
+		quint16 *r = registerAt(*battery, reg + i);
+		if (r == 0) {
+			pdu[0] = function | 0x80;
+			pdu[1] = IllegalDataAddress;
+			queueReply(pdu, 2, battery->address);
+			return length;
+		}
+		pdu[2 + 2 * i] = msb(*r);
+		pdu[3 + 2 * i] = lsb(*r);
+	}
+	queueReply(pdu, 2 + 2 * value, battery->address);
+	return length;
+}
+
+quint16 *ZbmSimulator::registerAt(Battery &battery, int reg)
+{
+	if (mStrict && !isKnownRegister(reg))
+		return 0;
+	if (reg >= 0 && reg < BlockSize)
+		return &battery.info[reg];
+	if (reg >= SetupBase && reg < SetupBase + SetupSize)
+		return &battery.setup[reg - SetupBase];
+	if (reg >= TelemetryBase && reg < TelemetryBase + BlockSize)
+		return &battery.telemetry[reg - TelemetryBase];
+	return 0;
+}
+
+ZbmSimulator::Battery *ZbmSimulator::findBattery(int address)
+{
+	int index = address - mBatteries.first().address;
+	if (index < 0 || index >= mBatteries.size())
+		return 0;
+	return &mBatteries[index];
+}
+
+void ZbmSimulator::queueReply(const quint8 *pdu, int length, int address)
+{
+	Q_ASSERT(length + 3 <= MaxFrameSize);
+	mTxFrame[0] = address;
+	memcpy(mTxFrame + 1, pdu, length);
+	quint16 crc = Crc16::getValue(mTxFrame, length + 1);
+	if (mCrcErrorRate > 0 && qrand() < mCrcErrorRate * RAND_MAX) {
+		crc ^= 0x0001;
+		++mCrcErrors;
+	}
+	mTxFrame[length + 1] = msb(crc);
+	mTxFrame[length + 2] = lsb(crc);
+	mTxLength = length + 3;
+	int delay = mLatency;
+	if (mJitter > 0)
+		delay += qrand() % (2 * mJitter + 1) - mJitter;
+	mReplyTimer->start(qMax(0, delay));
+}
@@ -0,0 +1,153 @@
+#ifndef ZBM_SIMULATOR_H
+#define ZBM_SIMULATOR_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QString>
+#include <QVector>
+
+class QSocketNotifier;
+class QTimer;
+
+/*!
+ * Simulates a number of ZBM batteries sharing a single Modbus RTU bus.
+ * The bus is the master side of a pseudo terminal. dbus-redflow should be
+ * started with the slave side (see `portName`) as communication port.
+ *
+ * Each battery implements the registers read by dbus-redflow:
+ * - 0x0003: firmware version, 0x0005: serial number, 0x000D: device ID
+ * - 0x1101-0x1102: application and measurement system (setup check)
+ * - 0x9001-0x9004, 0x9008, 0x9011-0x9019, 0x9030-0x9035: status and
+ *   telemetry
+ * Reading other registers yields an IllegalDataAddress exception.
+ * The telemetry values change slowly over time.
+ */
+class ZbmSimulator : public QObject
+{
+	Q_OBJECT
+public:
+	explicit ZbmSimulator(QObject *parent = 0);
+
+	~ZbmSimulator();
+
+	/*!
+	 * Creates the pseudo terminal. Returns false on failure.
+	 */
+	bool open();
+
+	/*!
+	 * Name of the slave side of the pseudo terminal (eg. /dev/pts/3).
+	 */
+	QString portName() const;
+
+	/*!
+	 * Sets the slave addresses of the simulated batteries (1-247).
+	 */
+	void setSlaveRange(int firstAddress, int lastAddress);
+
+	/*!
+	 * Sets the mean response time (in milliseconds) and the maximum random
+	 * deviation from the mean.
+	 */
+	void setLatency(int latency, int jitter);
+
+	/*!
+	 * Sets the fraction of replies (0-1) sent with an invalid CRC.
+	 */
+	void setCrcErrorRate(double rate);
+
+	/*!
+	 * If set, only the registers listed above may be read. Otherwise all
+	 * registers in the ranges 0x0000-0x003F, 0x1100-0x110F and
+	 * 0x9000-0x903F are readable (unused registers read as 0).
+	 */
+	void setStrict(bool strict);
+
+	/*!
+	 * Changes a register of the battery with slave address `address`.
+	 * Returns false if there is no such battery or register.
+	 */
+	bool setRegister(int address, int reg, quint16 value);
+
+signals:
+	/*!
+	 * Emitted when a valid request for one of the batteries has been
+	 * received, before the reply is built. Registers changed by the receivers
+	 * will be included in the reply.
+	 */
+	void requestReceived(int address, int function, int reg, int count);
+
+	/*!
+	 * Emitted when a reply has been written to the pseudo terminal.
+	 */
+	void replySent();
+
+private slots:
+	void onReadyRead();
+
+	void onReplyTimer();
+
+	void onUpdateTimer();
+
+private:
+	enum {
+		MaxFrameSize = 256,
+		// Registers 0x0000-0x003F and 0x9000-0x903F
+		BlockSize = 0x40,
+		TelemetryBase = 0x9000,
+		// Registers 0x1100-0x110F
+		SetupBase = 0x1100,
+		SetupSize = 0x10
+	};
+
+	struct Battery {
+		int address;
+		quint16 info[BlockSize];
+		quint16 setup[SetupSize];
+		quint16 telemetry[BlockSize];
+	};
+
+	void initBattery(Battery &battery, int address);
+
+	void processFrames();
+
+	/*!
+	 * Builds the reply to the request at the start of the receive buffer.
+	 * Returns the length of the request, 0 if the request is not complete,
+	 * or -1 if the buffer does not start with a valid request.
+	 */
+	int handleRequest();
+
+	/*!
+	 * Returns a pointer to `reg` of `battery`, or 0 if `reg` does not exist.
+	 */
+	quint16 *registerAt(Battery &battery, int reg);
+
+	Battery *findBattery(int address);
+
+	void queueReply(const quint8 *pdu, int length, int address);
+
+	int mFd;
+	// Slave side of the pseudo terminal. Kept open, so reading from the master
+	// does not fail while dbus-redflow is not running.
+	int mSlaveFd;
+	QString mPortName;
+	QSocketNotifier *mNotifier;
+	QTimer *mReplyTimer;
+	QTimer *mUpdateTimer;
+	QVector<Battery> mBatteries;
+	int mLatency;
+	int mJitter;
+	double mCrcErrorRate;
+	bool mStrict;
+	quint8 mRxFrame[MaxFrameSize];
+	int mRxLength;
+	quint8 mTxFrame[MaxFrameSize];
+	int mTxLength;
+	QElapsedTimer mUptime;
+	int mRequests;
+	int mCrcErrors;
+	int mUpdates;
+};
+
+#endif // ZBM_SIMULATOR_H